@@ -6,6 +6,7 @@
 #include "graphics/errors.h"
 #include "graphics/framebuffer.h"
 #include "graphics/image.h"
+#include "graphics/index_buffer.h"
 #include "graphics/shader.h"
 #include "graphics/texture.h"
 #include "graphics/vertex_buffer.h"
@@ -0,0 +1,139 @@
+#ifndef GRAPHICS_INDEX_BUFFER_H_INCLUDED
+#define GRAPHICS_INDEX_BUFFER_H_INCLUDED
+
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <GLFL/glfl.h>
+
+#include "graphics/vertex_buffer.h"
+#include "program/errors.h"
+
+namespace Graphics
+{
+    class IndexBuffers
+    {
+        IndexBuffers() = delete;
+        ~IndexBuffers() = delete;
+
+        // The element array binding is a part of the vertex array state, so we also remember which vertex array was bound.
+        inline static GLuint binding = 0;
+        inline static GLuint binding_vertex_array = 0;
+
+      public:
+        static void BindStorage(GLuint handle)
+        {
+            if (binding == handle && binding_vertex_array == Buffers::VertexArrayBinding())
+                return;
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, handle);
+            binding = handle;
+            binding_vertex_array = Buffers::VertexArrayBinding();
+        }
+
+        static GLuint StorageBinding()
+        {
+            return binding;
+        }
+    };
+
+    template <typename T> class IndexBuffer
+    {
+        static_assert(std::is_same_v<T, uint8_t> || std::is_same_v<T, uint16_t> || std::is_same_v<T, uint32_t>, "Index type must be `uint8_t`, `uint16_t` or `uint32_t`.");
+
+        struct Data
+        {
+            GLuint handle = 0;
+            int size = 0;
+        };
+        Data data;
+
+      public:
+        static constexpr GLenum gl_type = std::is_same_v<T, uint8_t>  ? GL_UNSIGNED_BYTE  :
+                                          std::is_same_v<T, uint16_t> ? GL_UNSIGNED_SHORT :
+                                                                        GL_UNSIGNED_INT;
+
+        IndexBuffer()
+        {
+            glGenBuffers(1, &data.handle);
+            if (!data.handle)
+                Program::Error("Unable to create an index buffer.");
+        }
+        IndexBuffer(int count, const T *source = 0, Usage usage = static_draw) : IndexBuffer() // Binds storage.
+        {
+            SetData(count, source, usage);
+        }
+
+        IndexBuffer(IndexBuffer &&other) noexcept : data(std::exchange(other.data, {})) {}
+        IndexBuffer &operator=(IndexBuffer &&other) noexcept
+        {
+            std::swap(data, other.data);
+            return *this;
+        }
+
+        ~IndexBuffer()
+        {
+            glDeleteBuffers(1, &data.handle);
+        }
+
+        explicit operator bool() const
+        {
+            return bool(data.handle);
+        }
+
+        GLuint Handle() const
+        {
+            return data.handle;
+        }
+
+        void BindStorage() const
+        {
+            IndexBuffers::BindStorage(data.handle);
+        }
+        static void UnbindStorage()
+        {
+            IndexBuffers::BindStorage(0);
+        }
+
+        int Size() const
+        {
+            return data.size;
+        }
+
+        void SetData(int count, const T *source = 0, Usage usage = static_draw) // Binds storage.
+        {
+            BindStorage();
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, count * sizeof(T), source, usage);
+            data.size = count;
+        }
+        void SetDataPart(int obj_offset, int count, const T *source) // Binds storage.
+        {
+            BindStorage();
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, obj_offset * sizeof(T), count * sizeof(T), source);
+        }
+    };
+
+    // Indices for `count` quads. Each quad is 4 consecutive vertices, in the order `0 1 / 2 3` (two rows of two corners), drawn as triangles `0 1 2` and `2 1 3`.
+    template <typename T> [[nodiscard]] std::vector<T> QuadIndices(int count)
+    {
+        if (count * std::uint64_t(4) > std::uint64_t(T(-1)) + 1)
+            Program::Error("Too many quads for this index type.");
+
+        std::vector<T> ret(count * 6);
+        for (int i = 0; i < count; i++)
+        {
+            T *out = ret.data() + i * 6;
+            T base = i * 4;
+            out[0] = base;
+            out[1] = base + 1;
+            out[2] = base + 2;
+            out[3] = base + 2;
+            out[4] = base + 1;
+            out[5] = base + 3;
+        }
+        return ret;
+    }
+}
+
+#endif
@@ -8,6 +8,7 @@
 #include <GLFL/glfl.h>
 
 #include "texture.h"
+#include "vertex_buffer.h"
 
 #include "reflection/complete.h"
 #include "program/errors.h"
@@ -116,7 +117,7 @@ namespace Graphics::Shader
                     using field_type = typename refl::template field_type<i>;
                     header += cfg.attribute;
                     header += ' ';
-                    header += GlslTypeName<field_type>();
+                    header += GlslTypeName<typename AttribFormat<field_type>::glsl_type>();
                     header += ' ';
                     header += pref.attribute_prefix;
                     header += refl::field_name(i);
@@ -178,7 +179,7 @@ namespace Graphics::Shader
                 using refl = Refl::Interface<T>;
                 refl::for_each_field([&](auto index)
                 {
-                    ret.push_back(pref.attribute_prefix + refl::field_name(index.value));
+                    ret.push_back(pref.attribute_prefix + std::string(refl::field_name(index.value)));
                 });
 
                 return ret;
@@ -286,7 +287,7 @@ namespace Graphics::Shader
                 {
                     constexpr int i = index.value;
                     // Note that we don't need to check the return value. Even if a uniform is not found and -1 location is returned, glUniform* silently no-op when it's used.
-                    AssignUniformLocation(refl.template field_value<i>(), glGetUniformLocation(data.handle, (pref.uniform_prefix + refl.field_name(i)).c_str()));
+                    AssignUniformLocation(refl.template field_value<i>(), glGetUniformLocation(data.handle, (pref.uniform_prefix + std::string(refl.field_name(i))).c_str()));
                 });
             }
         }
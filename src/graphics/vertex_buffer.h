@@ -1,10 +1,14 @@
 #ifndef GRAPHICS_VERTEX_BUFFER_H_INCLUDED
 #define GRAPHICS_VERTEX_BUFFER_H_INCLUDED
 
+#include <cstdint>
+#include <cstring>
+#include <limits>
 #include <type_traits>
 #include <utility>
 
 #include <GLFL/glfl.h>
+#include <GLFL/glfl_func_indices.h>
 
 #include "program/errors.h"
 #include "reflection/complete.h"
@@ -31,6 +35,126 @@ namespace Graphics
         stream_draw  = GL_STREAM_DRAW,
     };
 
+    /* Attribute types.
+     * Float scalars and vectors are passed to shaders as is. Integral ones are passed as integers, so shaders see them as `int`, `ivecN`, `uint` or `uvecN`.
+     * The wrappers below store smaller types that shaders see as floats. They're implicitly constructible from floats, so filling vertices doesn't change.
+     */
+
+    template <typename T> struct Normalized // Integers, mapped to [0;1], or to [-1;1] if signed.
+    {
+        using base = Math::vec_base_t<T>;
+        static_assert(std::is_integral_v<base>, "The underlying type must be integral.");
+
+        T value{};
+
+        Normalized() {}
+        Normalized(Math::change_vec_base_t<T, float> obj) : value(T(Math::iround(Math::clamp(obj, std::is_signed_v<base> ? -1 : 0, 1) * float(std::numeric_limits<base>::max())))) {}
+    };
+
+    template <typename T> struct Scaled // Integers, converted to floats without changing the values.
+    {
+        static_assert(std::is_integral_v<Math::vec_base_t<T>>, "The underlying type must be integral.");
+
+        T value{};
+
+        Scaled() {}
+        Scaled(Math::change_vec_base_t<T, float> obj) : value(T(Math::iround(obj))) {}
+    };
+
+    template <typename T> struct Half // Half-precision floats. `T` is the type seen by shaders, either `float` or a float vector.
+    {
+        static_assert(std::is_same_v<Math::vec_base_t<T>, float>, "The underlying type must be float-based.");
+
+        Math::change_vec_base_t<T, uint16_t> value{};
+
+        Half() {}
+        Half(T obj) : value(Math::apply_elementwise(FromFloat, obj)) {}
+
+        static uint16_t FromFloat(float f) // Rounds to nearest even, overflows to infinity.
+        {
+            uint32_t x;
+            std::memcpy(&x, &f, sizeof x);
+            uint16_t sign = x >> 16 & 0x8000;
+            uint32_t mantissa = x & 0x7fffff;
+            int exponent = int(x >> 23 & 0xff);
+
+            if (exponent == 0xff) // Infinity or NaN.
+                return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+
+            exponent += 15 - 127;
+            if (exponent >= 31)
+                return sign | 0x7c00;
+
+            int shift = 13;
+            uint32_t ret;
+            if (exponent > 0)
+            {
+                ret = exponent << 10 | mantissa >> shift;
+            }
+            else // Subnormal.
+            {
+                if (exponent < -10)
+                    return sign;
+                mantissa |= 0x800000;
+                shift = 14 - exponent;
+                ret = mantissa >> shift;
+            }
+
+            uint32_t rest = mantissa & ((1u << shift) - 1), half = 1u << (shift - 1);
+            if (rest > half || (rest == half && ret & 1))
+                ret++; // This can carry into the exponent, which is correct.
+            return sign | ret;
+        }
+    };
+
+    template <typename T> struct AttribFormat // How an attribute of type `T` is passed to shaders.
+    {
+        using storage = T;
+        static constexpr bool normalized = 0;
+        static constexpr bool integral = std::is_integral_v<Math::vec_base_t<T>>;
+        using glsl_type = Math::change_vec_base_t<T, std::conditional_t<!integral, float, std::conditional_t<std::is_signed_v<Math::vec_base_t<T>>, int, unsigned int>>>;
+    };
+    template <typename T> struct AttribFormat<Normalized<T>>
+    {
+        using storage = T;
+        static constexpr bool normalized = 1;
+        static constexpr bool integral = 0;
+        using glsl_type = Math::change_vec_base_t<T, float>;
+    };
+    template <typename T> struct AttribFormat<Scaled<T>>
+    {
+        using storage = T;
+        static constexpr bool normalized = 0;
+        static constexpr bool integral = 0;
+        using glsl_type = Math::change_vec_base_t<T, float>;
+    };
+    template <typename T> struct AttribFormat<Half<T>>
+    {
+        using storage = Math::change_vec_base_t<T, uint16_t>;
+        static constexpr bool normalized = 0;
+        static constexpr bool integral = 0;
+        using glsl_type = T;
+    };
+
+    template <typename T> inline constexpr bool is_half_attrib = 0;
+    template <typename T> inline constexpr bool is_half_attrib<Half<T>> = 1;
+
+    template <typename T> constexpr GLenum AttribComponentType() // `T` is an attribute type.
+    {
+        using base = Math::vec_base_t<typename AttribFormat<T>::storage>;
+             if constexpr (is_half_attrib<T>) return GL_HALF_FLOAT;
+        else if constexpr (std::is_same_v<base, float   >) return GL_FLOAT;
+        else if constexpr (std::is_same_v<base, int8_t  >) return GL_BYTE;
+        else if constexpr (std::is_same_v<base, uint8_t >) return GL_UNSIGNED_BYTE;
+        else if constexpr (std::is_same_v<base, int16_t >) return GL_SHORT;
+        else if constexpr (std::is_same_v<base, uint16_t>) return GL_UNSIGNED_SHORT;
+        else if constexpr (std::is_same_v<base, int32_t >) return GL_INT;
+        else if constexpr (std::is_same_v<base, uint32_t>) return GL_UNSIGNED_INT;
+        else static_assert(!sizeof(T), "This attribute type is not supported.");
+    }
+
+    template <typename T> class IndexBuffer; // See `graphics/index_buffer.h`.
+
     class Buffers
     {
         Buffers() = delete;
@@ -39,8 +163,14 @@ namespace Graphics
         // Only one buffer can be bound at a time. Optionally it can be draw-bound at the same time.
         inline static GLuint binding = 0;
         inline static GLuint binding_draw = 0;
+        inline static bool binding_draw_per_instance = 0;
+
+        inline static GLuint binding_vertex_array = 0;
+        inline static int vertex_arrays_supported = -1; // -1 means not checked yet.
 
+        // The state of the default vertex array. It's only used if vertex arrays are not supported.
         inline static int active_attrib_count = 0;
+        inline static int per_instance_attrib_count = 0; // Attributes below this index advance once per instance rather than per vertex.
 
         static void SetActiveAttribCount(int count)
         {
@@ -52,31 +182,27 @@ namespace Graphics
                 do glDisableVertexAttribArray(--active_attrib_count); while (active_attrib_count > count);
         }
 
-      public:
-        static void BindStorage(GLuint handle)
+        static void SetPerInstanceAttribCount(int count)
         {
-            if (binding == handle)
+            if (count == per_instance_attrib_count)
                 return;
-            glBindBuffer(GL_ARRAY_BUFFER, handle);
-            binding = handle;
-            binding_draw = 0;
+            if (per_instance_attrib_count < count)
+                do glVertexAttribDivisor(per_instance_attrib_count++, 1); while (per_instance_attrib_count < count);
+            else
+                do glVertexAttribDivisor(--per_instance_attrib_count, 0); while (per_instance_attrib_count > count);
         }
-        template <typename T> static void BindDraw(GLuint handle)
-        {
-            if (binding_draw == handle)
-                return;
-            BindStorage(handle);
 
-            constexpr bool is_reflected = Refl::is_reflected<T>;
-            int field_count;
-            if constexpr (is_reflected)
-                field_count = Refl::Interface<T>::field_count();
+        template <typename T> static int AttribCount()
+        {
+            if constexpr (Refl::is_reflected<T>)
+                return Refl::Interface<T>::field_count();
             else
-                field_count = 0;
-
-            SetActiveAttribCount(field_count);
+                return 0;
+        }
 
-            if constexpr (is_reflected)
+        template <typename T> static void SetAttribPointers() // Uses the buffer bound to `GL_ARRAY_BUFFER`.
+        {
+            if constexpr (Refl::is_reflected<T>)
             {
                 using refl = Refl::Interface<T>;
 
@@ -86,16 +212,108 @@ namespace Graphics
                 {
                     constexpr int i = index.value;
                     using field_type = typename refl::template field_type<i>;
-                    static_assert(std::is_same_v<Math::vec_base_t<field_type>, float>, "Non-float attributes are not supported.");
-                    glVertexAttribPointer(attrib++, Math::vec_size_v<field_type>, GL_FLOAT, 0, sizeof(T), (void *)offset);
+                    using format = AttribFormat<field_type>;
+                    static_assert(sizeof(field_type) == sizeof(typename format::storage), "Unexpected padding in attribute type.");
+                    constexpr int size = Math::vec_size_v<typename format::storage>;
+                    constexpr GLenum type = AttribComponentType<field_type>();
+                    if constexpr (format::integral)
+                        glVertexAttribIPointer(attrib++, size, type, sizeof(T), (void *)offset);
+                    else
+                        glVertexAttribPointer(attrib++, size, type, format::normalized, sizeof(T), (void *)offset);
                     offset += sizeof(field_type);
                 });
 
                 if (offset != int(sizeof(T)))
                     Program::Error("Unexpected padding in attribute structure.");
             }
+        }
+
+        static void BindVertexArrayHandle(GLuint handle)
+        {
+            if (binding_vertex_array == handle)
+                return;
+            glBindVertexArray(handle);
+            binding_vertex_array = handle;
+        }
+
+      public:
+        static void BindStorage(GLuint handle)
+        {
+            if (binding == handle)
+                return;
+            glBindBuffer(GL_ARRAY_BUFFER, handle);
+            binding = handle;
+            binding_draw = 0;
+        }
+
+        // Sets up attributes of the default vertex array. Only works if vertex arrays are not supported, see `VertexArraysSupported()`.
+        template <typename T> static void BindDraw(GLuint handle, bool per_instance = 0) // If `per_instance` is true, each element is used for a whole instance.
+        {
+            if (binding_draw == handle && binding_draw_per_instance == per_instance)
+                return;
+            BindStorage(handle);
+
+            int field_count = AttribCount<T>();
+            SetActiveAttribCount(field_count);
+            SetPerInstanceAttribCount(per_instance ? field_count : 0);
+            SetAttribPointers<T>();
 
             binding_draw = handle;
+            binding_draw_per_instance = per_instance;
+        }
+
+        [[nodiscard]] static bool VertexArraysSupported() // Needs a context. If this returns false, `BindDraw()` is used instead of vertex arrays.
+        {
+            if (vertex_arrays_supported == -1)
+                vertex_arrays_supported = glfl::active_context()->ptrs[glfl::indices::GenVertexArrays] != 0;
+            return vertex_arrays_supported;
+        }
+
+        // Creates a vertex array that remembers the attribute layout of `T`, stored in the buffer `handle`. Binds it for drawing.
+        template <typename T> [[nodiscard]] static GLuint CreateVertexArray(GLuint handle, bool per_instance = 0)
+        {
+            GLuint ret = 0;
+            glGenVertexArrays(1, &ret);
+            if (!ret)
+                Program::Error("Unable to create a vertex array.");
+
+            BindVertexArrayHandle(ret);
+            BindStorage(handle);
+            int field_count = AttribCount<T>();
+            for (int i = 0; i < field_count; i++)
+            {
+                glEnableVertexAttribArray(i);
+                if (per_instance)
+                    glVertexAttribDivisor(i, 1);
+            }
+            SetAttribPointers<T>();
+
+            binding_draw = handle;
+            binding_draw_per_instance = per_instance;
+            return ret;
+        }
+        static void DestroyVertexArray(GLuint vertex_array)
+        {
+            if (binding_vertex_array == vertex_array)
+            {
+                binding_vertex_array = 0;
+                binding_draw = 0;
+            }
+            glDeleteVertexArrays(1, &vertex_array);
+        }
+        static void BindVertexArray(GLuint vertex_array, GLuint handle, bool per_instance = 0) // `handle` and `per_instance` must be the same as when creating the array.
+        {
+            BindVertexArrayHandle(vertex_array);
+            binding_draw = handle;
+            binding_draw_per_instance = per_instance;
+        }
+
+        static void UnbindDraw()
+        {
+            if (VertexArraysSupported())
+                BindVertexArray(0, 0);
+            else
+                BindDraw<void>(0);
         }
 
         static GLuint StorageBinding()
@@ -106,6 +324,10 @@ namespace Graphics
         {
             return binding_draw;
         }
+        static GLuint VertexArrayBinding()
+        {
+            return binding_vertex_array;
+        }
     };
 
     template <typename T> class VertexBuffer
@@ -116,9 +338,26 @@ namespace Graphics
         {
             GLuint handle = 0;
             int size = 0;
+            mutable GLuint vertex_arrays[2] = {}; // For drawing per vertex and per instance. Created on demand.
         };
         Data data;
 
+        void BindDrawLow(bool per_instance) const
+        {
+            static_assert(is_reflected, "Can't bind for drawing, since element type is not reflected.");
+            if (!Buffers::VertexArraysSupported())
+            {
+                Buffers::BindDraw<T>(data.handle, per_instance);
+                return;
+            }
+
+            GLuint &vertex_array = data.vertex_arrays[per_instance];
+            if (!vertex_array)
+                vertex_array = Buffers::CreateVertexArray<T>(data.handle, per_instance);
+            else
+                Buffers::BindVertexArray(vertex_array, data.handle, per_instance);
+        }
+
       public:
         static constexpr bool is_reflected = Refl::is_reflected<T>;
 
@@ -143,6 +382,11 @@ namespace Graphics
 
         ~VertexBuffer()
         {
+            for (GLuint vertex_array : data.vertex_arrays)
+            {
+                if (vertex_array)
+                    Buffers::DestroyVertexArray(vertex_array);
+            }
             glDeleteBuffers(1, &data.handle);
         }
 
@@ -169,14 +413,17 @@ namespace Graphics
             return data.handle == Buffers::StorageBinding();
         }
 
-        void BindDraw() const
+        void BindDraw() const // Uses a vertex array if they are supported.
         {
-            static_assert(is_reflected, "Can't bind for drawing, since element type is not reflected.");
-            Buffers::BindDraw<T>(data.handle);
+            BindDrawLow(0);
+        }
+        void BindDrawPerInstance() const // Uses a vertex array if they are supported.
+        {
+            BindDrawLow(1);
         }
         static void UnbindDraw()
         {
-            Buffers::BindDraw<void>(0);
+            Buffers::UnbindDraw();
         }
         [[nodiscard]] bool DrawBound() const
         {
@@ -219,6 +466,87 @@ namespace Graphics
         {
             Draw(p, 0, Size());
         }
+
+        // Draws `count` indices starting from `index_from`. `base_vertex` is added to every index. Binds for drawing, and binds the index buffer.
+        template <typename I> void DrawIndexed(DrawMode p, const IndexBuffer<I> &indices, int index_from, int count, int base_vertex = 0)
+        {
+            BindDraw();
+            indices.BindStorage();
+            glDrawElementsBaseVertex(p, count, IndexBuffer<I>::gl_type, (void *)(index_from * sizeof(I)), base_vertex);
+        }
+
+        // Draws `instance_count` instances of `vertex_count` vertices each. Every element of the buffer is one instance, starting from the first one.
+        // There are no per-vertex attributes, shaders have to compute them from `gl_VertexID`. Binds for drawing per instance.
+        void DrawInstanced(DrawMode p, int vertex_count, int instance_count)
+        {
+            BindDrawPerInstance();
+            glDrawArraysInstanced(p, 0, vertex_count, instance_count);
+        }
+    };
+
+    // A vertex buffer for data that is regenerated every frame.
+    // Each upload is appended after the previous one, without synchronizing with the GPU, which might be still drawing from the earlier parts.
+    // When the buffer is full, it's orphaned: the driver allocates new storage for it, and frees the old one after the GPU is done with it.
+    // This way uploading never waits for the GPU, and the buffer can be large enough to hold several frames.
+    template <typename T> class StreamVertexBuffer
+    {
+        VertexBuffer<T> buffer;
+        int pos = 0; // Where the next upload goes.
+
+      public:
+        static constexpr bool is_reflected = VertexBuffer<T>::is_reflected;
+
+        StreamVertexBuffer(int capacity) : buffer(capacity, 0, stream_draw) {} // Binds storage.
+
+        explicit operator bool() const
+        {
+            return bool(buffer);
+        }
+
+        [[nodiscard]] int Capacity() const
+        {
+            return buffer.Size();
+        }
+
+        // Uploads vertices and returns the index of the first one, for drawing. `count` must not exceed the capacity. Binds storage.
+        int Upload(int count, const T *source)
+        {
+            if (count > Capacity())
+                Program::Error("Too many vertices for a stream vertex buffer.");
+
+            if (pos + count > Capacity())
+            {
+                buffer.SetData(Capacity(), 0, stream_draw); // Orphan the old storage.
+                pos = 0;
+            }
+            else
+            {
+                buffer.BindStorage();
+            }
+
+            void *ptr = glMapBufferRange(GL_ARRAY_BUFFER, pos * sizeof(T), count * sizeof(T), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            if (!ptr)
+                Program::Error("Unable to map a stream vertex buffer.");
+            std::memcpy(ptr, source, count * sizeof(T));
+            glUnmapBuffer(GL_ARRAY_BUFFER); // This can fail if the storage was lost (e.g. on mode switch), but then we lose only one batch.
+
+            int ret = pos;
+            pos += count;
+            return ret;
+        }
+
+        void Draw(DrawMode p, int from, int count) // Binds for drawing.
+        {
+            buffer.Draw(p, from, count);
+        }
+        void Draw(DrawMode p, int count, const T *source) // Uploads the vertices and draws them. Binds for drawing.
+        {
+            Draw(p, Upload(count, source), count);
+        }
+        template <typename I> void DrawIndexed(DrawMode p, const IndexBuffer<I> &indices, int index_from, int count, int base_vertex) // Binds for drawing, and binds the index buffer.
+        {
+            buffer.DrawIndexed(p, indices, index_from, count, base_vertex);
+        }
     };
 }
 
@@ -1,8 +1,11 @@
 #include "messagebox.h"
 
-#include <SDL2/SDL.h>
-
-#include "window.h"
+#ifdef HEADLESS
+#  include <iostream>
+#else
+#  include <SDL2/SDL.h>
+#  include "window.h"
+#endif
 
 namespace Interface
 {
@@ -11,6 +14,13 @@ namespace Interface
         MessageBox(MessageBoxType::info, title, message);
     }
 
+    #ifdef HEADLESS
+    void MessageBox(MessageBoxType type, std::string title, std::string message) // There is no window to show a message box in, so we print to stderr.
+    {
+        (void)type;
+        std::cerr << title << ": " << message << '\n';
+    }
+    #else
     void MessageBox(MessageBoxType type, std::string title, std::string message)
     {
         int type_value;
@@ -30,4 +40,5 @@ namespace Interface
 
         SDL_ShowSimpleMessageBox(type_value, title.c_str(), message.c_str(), Window::Instance().Handle());
     }
+    #endif
 }
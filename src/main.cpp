@@ -1,12 +1,29 @@
 #include "master.h"
 
-#include <deque>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
 #include <vector>
 
+// Define `HEADLESS` to build the simulation alone: no window, no OpenGL context and no audio device.
+// In this mode `World` ticks as fast as possible, and the number of ticks per second is printed.
+
+// Command line: `--record <file>` saves the input of every tick, `--replay <file>` plays it back, `--seed <n>` sets the random seed.
+// `--convert-map <file>` makes a binary map from a text map, and exits.
+// `--benchmark-parser <file>` parses a text map and writes it back several times, prints the speed, and exits.
+// Headless builds also accept a tick count, which is ignored when replaying.
+
+#ifndef HEADLESS
 #define main SDL_main
+#endif
 
 Program::Parachute error_parachute;
 
@@ -14,10 +31,12 @@ constexpr bool debug_mode = 0;
 bool fullscreen = !debug_mode;
 
 constexpr ivec2 screen_sz = ivec2(1920,1080)/4;
+#ifndef HEADLESS
 Interface::Window win("The last witch-knight", screen_sz*2, Interface::Window::windowed, Interface::Window::Settings{}.MinSize(screen_sz));
 Audio::Context audio;
-Metronome metronome;
 Interface::Mouse mouse;
+#endif
+Metronome metronome;
 
 
 constexpr ivec2 tile_size = ivec2(16,16);
@@ -44,6 +63,23 @@ namespace Sounds
         SOUND( boss_dash          , 0.3  ) \
         SOUND( boss_dies          , 0.3  ) \
 
+    #ifdef HEADLESS
+    struct Sink // Stands in for `Audio::Source` when there is no audio device.
+    {
+        Sink &relative(bool = 1) {return *this;}
+    };
+
+    #define SOUND(NAME, RAND) \
+        Sink NAME(fvec2, float = 1, float = 0) {return {};}
+    SOUND_LIST
+    #undef SOUND
+
+    #undef SOUND_LIST
+
+    void ListenerPos(fvec3) {}
+
+    void Init() {}
+    #else
     namespace Buffers
     {
         #define SOUND(NAME, RAND) \
@@ -55,13 +91,18 @@ namespace Sounds
     #define SOUND(NAME, RAND) \
         auto NAME(fvec2 pos, float vol = 1, float pitch = 0) \
         { \
-            return Buffers::NAME(vol, std::pow(2, pitch + random_real_range(-1,1) * RAND)).pos(pos.to_vec3()); \
+            return Buffers::NAME(vol, std::pow(2, pitch + random_real_range(Rand::audio, -1, 1) * RAND)).pos(pos.to_vec3()); \
         }
     SOUND_LIST
     #undef SOUND
 
     #undef SOUND_LIST
 
+    void ListenerPos(fvec3 pos)
+    {
+        Audio::ListenerPos(pos);
+    }
+
     Audio::Buffer theme_buf;
     Audio::Source theme;
     constexpr float theme_vol = 0.3;
@@ -86,8 +127,26 @@ namespace Sounds
             theme.loop(1).volume(theme_vol).play().relative();
         }
     }
+    #endif
 }
 
+#ifdef HEADLESS
+namespace Draw // No-op sinks, so that the world code compiles without a graphics context.
+{
+    template <int N> struct Src
+    {
+        template <typename ...P> Src(const P &...) {}
+    };
+    using Src3 = Src<3>;
+    using Src4 = Src<4>;
+
+    void Tri(fvec2, fvec2, fvec2, fvec2, Src<3>) {}
+    void Quad(fvec2, fvec2, fvec2, Src<4>) {}
+    void Quad(fvec2, fvec2, Src<4>) {}
+    template <int A = -1> void Text(fvec2, std::string, fvec3, float = 1, float = 1) {}
+    void Light(fvec2, float, fvec3) {}
+}
+#else
 namespace Draw
 {
     Graphics::Texture texture_main;
@@ -162,9 +221,9 @@ namespace Draw
             Reflect(attribs_t)
             (
                 (fvec2)(pos),
-                (fvec4)(color),
-                (fvec2)(texcoord),
-                (fvec3)(factors),
+                (Graphics::Normalized<u8vec4>)(color),
+                (Graphics::Scaled<u16vec2>)(texcoord),
+                (Graphics::Normalized<u8vec4>)(factors), // The last component is unused.
             )
         };
         struct uniforms_t
@@ -179,6 +238,26 @@ namespace Draw
         };
         uniforms_t uniforms;
 
+        const std::string fragment_source = // Also used by `ShaderSprite`.
+        //{
+        R"(
+        varying vec4 v_color;
+        varying vec2 v_texcoord;
+        varying vec3 v_factors;
+        void main()
+        {
+            vec4 tex_color = texture2D(u_texture, v_texcoord);
+            gl_FragColor = vec4(v_color.rgb * (1. - v_factors.x) + tex_color.rgb * v_factors.x,
+                                v_color.a   * (1. - v_factors.y) + tex_color.a   * v_factors.y);
+            vec4 modified = u_color_matrix * vec4(gl_FragColor.rgb, 1);
+            gl_FragColor.a *= modified.a;
+            gl_FragColor.rgb = modified.rgb * gl_FragColor.a;
+            gl_FragColor.a *= v_factors.z;
+        }
+        )"
+        //}
+        ;
+
         Graphics::Shader::Program shader("Main", {}, {}, Meta::tag<attribs_t>{}, uniforms,
         //{
         R"(
@@ -189,11 +268,31 @@ namespace Draw
         {
             v_color = a_color;
             v_texcoord = a_texcoord / u_tex_size;
-            v_factors = a_factors;
+            v_factors = a_factors.xyz;
             gl_Position = u_matrix * vec4(a_pos, 0, 1);
         }
         )" //}
         ,
+        fragment_source);
+    }
+
+    namespace ShaderSprite // Same as `ShaderMain`, but draws axis-aligned rectangles, one per instance.
+    {
+        struct attribs_t
+        {
+            Reflect(attribs_t)
+            (
+                (fvec2)(pos),
+                (fvec2)(size),
+                (Graphics::Scaled<u16vec2>)(tex_pos),
+                (Graphics::Scaled<i16vec2>)(tex_size),
+                (Graphics::Normalized<u8vec4>)(color),
+                (Graphics::Normalized<u8vec4>)(factors), // The last component is unused.
+            )
+        };
+        ShaderMain::uniforms_t uniforms;
+
+        Graphics::Shader::Program shader("Sprite", {}, {}, Meta::tag<attribs_t>{}, uniforms,
         //{
         R"(
         varying vec4 v_color;
@@ -201,17 +300,15 @@ namespace Draw
         varying vec3 v_factors;
         void main()
         {
-            vec4 tex_color = texture2D(u_texture, v_texcoord);
-            gl_FragColor = vec4(v_color.rgb * (1. - v_factors.x) + tex_color.rgb * v_factors.x,
-                                v_color.a   * (1. - v_factors.y) + tex_color.a   * v_factors.y);
-            vec4 modified = u_color_matrix * vec4(gl_FragColor.rgb, 1);
-            gl_FragColor.a *= modified.a;
-            gl_FragColor.rgb = modified.rgb * gl_FragColor.a;
-            gl_FragColor.a *= v_factors.z;
+            vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1); // For a triangle strip.
+            v_color = a_color;
+            v_texcoord = (a_tex_pos + a_tex_size * corner) / u_tex_size;
+            v_factors = a_factors.xyz;
+            gl_Position = u_matrix * vec4(a_pos + a_size * corner, 0, 1);
         }
-        )"
-        //}
-        );
+        )" //}
+        ,
+        ShaderMain::fragment_source);
     }
 
     namespace ShaderLight
@@ -221,8 +318,8 @@ namespace Draw
             Reflect(attribs_t)
             (
                 (fvec2)(pos),
-                (fvec3)(color),
-                (fvec2)(texcoord),
+                (Graphics::Half<fvec4>)(color), // Can be brighter than 1. The last component is unused.
+                (Graphics::Scaled<u16vec2>)(texcoord),
             )
         };
         struct uniforms_t
@@ -243,7 +340,7 @@ namespace Draw
         varying vec2 v_texcoord;
         void main()
         {
-            v_color = a_color;
+            v_color = a_color.rgb;
             v_texcoord = a_texcoord / u_tex_size;
             gl_Position = u_matrix * vec4(a_pos, 0, 1);
         }
@@ -330,54 +427,104 @@ namespace Draw
         buffer.Draw(Graphics::triangle_fan);
     }
 
+    // Sprites are drawn as indexed quads, 4 vertices each. All batches share one index buffer.
+    constexpr int max_quads = 5000; // Per batch.
+    static_assert(max_quads * 4 <= 0x10000, "Indices must fit into `uint16_t`.");
+
+    const Graphics::IndexBuffer<uint16_t> &QuadIndexBuffer()
+    {
+        static Graphics::IndexBuffer<uint16_t> ret = []
+        {
+            std::vector<uint16_t> indices = Graphics::QuadIndices<uint16_t>(max_quads);
+            return Graphics::IndexBuffer<uint16_t>(indices.size(), indices.data());
+        }();
+        return ret;
+    }
+
+    namespace SpriteQueue
+    {
+        void Flush();
+    }
+
     namespace Queue
     {
         using Attribs = ShaderMain::attribs_t;
-        std::vector<Attribs> array;
-        constexpr int size = 3000;
-        static_assert(size % 3 == 0);
+        std::vector<Attribs> array = std::vector<Attribs>(max_quads * 4);
+        int quad_count = 0;
+
+        void Flush()
+        {
+            if (quad_count > 0)
+            {
+                static Graphics::StreamVertexBuffer<Attribs> buffer(max_quads * 4 * 4);
+                int base_vertex = buffer.Upload(quad_count * 4, array.data());
+                ShaderMain::shader.Bind();
+                buffer.DrawIndexed(Graphics::triangles, QuadIndexBuffer(), 0, quad_count * 6, base_vertex);
+                quad_count = 0;
+            }
+        }
+
+        [[nodiscard]] Attribs *AddQuads(int count) // Returns `count * 4` vertices for the caller to fill. `count` must not exceed `max_quads`.
+        {
+            SpriteQueue::Flush(); // To keep the drawing order.
+            if (quad_count + count > max_quads)
+                Flush();
+            Attribs *ret = array.data() + quad_count * 4;
+            quad_count += count;
+            return ret;
+        }
+    }
+    namespace SpriteQueue
+    {
+        using Attribs = ShaderSprite::attribs_t;
+        constexpr int size = 10000; // Sprites per batch.
+        std::vector<Attribs> array = std::vector<Attribs>(size);
+        int count = 0;
 
         void Flush()
         {
-            if (array.size() > 0)
+            if (count > 0)
             {
-                static Graphics::VertexBuffer<Attribs> buffer(size);
-                buffer.SetDataPart(0, array.size(), array.data());
-                buffer.Draw(Graphics::triangles, array.size());
-                array.clear();
+                static Graphics::VertexBuffer<Attribs> buffer;
+                buffer.SetData(count, array.data(), Graphics::stream_draw); // This orphans the previous storage, so we don't wait for the GPU.
+                ShaderSprite::shader.Bind();
+                buffer.DrawInstanced(Graphics::triangle_strip, 4, count);
+                count = 0;
             }
         }
 
-        void Push(fvec2 pos, fvec4 color, fvec2 texcoord, fvec3 factors)
+        [[nodiscard]] Attribs &Add()
         {
-            if (array.size() >= size)
+            Queue::Flush(); // To keep the drawing order.
+            if (count >= size)
                 Flush();
-            array.push_back({pos, color, texcoord, factors});
+            return array[count++];
         }
     }
     namespace LightQueue
     {
         using Attribs = ShaderLight::attribs_t;
-        std::vector<Attribs> array;
-        constexpr int size = 3000;
-        static_assert(size % 3 == 0);
+        std::vector<Attribs> array = std::vector<Attribs>(max_quads * 4);
+        int quad_count = 0;
 
         void Flush()
         {
-            if (array.size() > 0)
+            if (quad_count > 0)
             {
-                static Graphics::VertexBuffer<Attribs> buffer(size);
-                buffer.SetDataPart(0, array.size(), array.data());
-                buffer.Draw(Graphics::triangles, array.size());
-                array.clear();
+                static Graphics::StreamVertexBuffer<Attribs> buffer(max_quads * 4 * 4);
+                int base_vertex = buffer.Upload(quad_count * 4, array.data());
+                buffer.DrawIndexed(Graphics::triangles, QuadIndexBuffer(), 0, quad_count * 6, base_vertex);
+                quad_count = 0;
             }
         }
 
-        void Push(fvec2 pos, fvec3 color, fvec2 texcoord)
+        [[nodiscard]] Attribs *AddQuads(int count) // Returns `count * 4` vertices for the caller to fill. `count` must not exceed `max_quads`.
         {
-            if (array.size() >= size)
+            if (quad_count + count > max_quads)
                 Flush();
-            array.push_back({pos, color, texcoord});
+            Attribs *ret = array.data() + quad_count * 4;
+            quad_count += count;
+            return ret;
         }
     }
 
@@ -425,24 +572,31 @@ namespace Draw
     using Src3 = Src<3>;
     using Src4 = Src<4>;
 
-    void Tri(fvec2 pos, fvec2 a, fvec2 b, fvec2 c, Src<3> src)
+    void Tri(fvec2 pos, fvec2 a, fvec2 b, fvec2 c, Src<3> src) // Drawn as a quad with the last two vertices merged, so the second triangle is degenerate.
     {
-        Queue::Push(pos + a, src.colors[0], src.texcoords[0], src.factors[0]);
-        Queue::Push(pos + b, src.colors[1], src.texcoords[1], src.factors[1]);
-        Queue::Push(pos + c, src.colors[2], src.texcoords[2], src.factors[2]);
+        Queue::Attribs *v = Queue::AddQuads(1);
+        v[0] = {pos + a, src.colors[0], src.texcoords[0], src.factors[0].to_vec4(0)};
+        v[1] = {pos + b, src.colors[1], src.texcoords[1], src.factors[1].to_vec4(0)};
+        v[2] = {pos + c, src.colors[2], src.texcoords[2], src.factors[2].to_vec4(0)};
+        v[3] = v[2];
     }
     void Quad(fvec2 pos, fvec2 a, fvec2 b, Src<4> src)
     {
-        Queue::Push(pos        , src.colors[0], src.texcoords[0], src.factors[0]);
-        Queue::Push(pos + a    , src.colors[1], src.texcoords[1], src.factors[1]);
-        Queue::Push(pos     + b, src.colors[2], src.texcoords[2], src.factors[2]);
-        Queue::Push(pos     + b, src.colors[2], src.texcoords[2], src.factors[2]);
-        Queue::Push(pos + a    , src.colors[1], src.texcoords[1], src.factors[1]);
-        Queue::Push(pos + a + b, src.colors[3], src.texcoords[3], src.factors[3]);
+        Queue::Attribs *v = Queue::AddQuads(1);
+        v[0] = {pos        , src.colors[0], src.texcoords[0], src.factors[0].to_vec4(0)};
+        v[1] = {pos + a    , src.colors[1], src.texcoords[1], src.factors[1].to_vec4(0)};
+        v[2] = {pos     + b, src.colors[2], src.texcoords[2], src.factors[2].to_vec4(0)};
+        v[3] = {pos + a + b, src.colors[3], src.texcoords[3], src.factors[3].to_vec4(0)};
     }
-    void Quad(fvec2 pos, fvec2 size, Src<4> src)
+    void Quad(fvec2 pos, fvec2 size, Src<4> src) // Drawn as a sprite instance. All `Src` constructors use the same color and factors for every corner.
     {
-        Quad(pos, size.set_y(0), size.set_x(0), src);
+        SpriteQueue::Add() = {pos, size, src.texcoords[0], src.texcoords[3] - src.texcoords[0], src.colors[0], src.factors[0].to_vec4(0)};
+    }
+
+    void Flush() // Draws everything queued with `Tri()` and `Quad()`.
+    {
+        Queue::Flush();
+        SpriteQueue::Flush();
     }
     template <int A = -1> void Text(fvec2 pos, std::string str, fvec3 color, float alpha = 1, float beta = 1)
     {
@@ -493,12 +647,12 @@ namespace Draw
     void Light(fvec2 pos, float rad, fvec3 color)
     {
         constexpr int m = 8; // Margin.
-        LightQueue::Push(pos + fvec2(-rad, -rad), color, fvec2(m    ,1024+m    ));
-        LightQueue::Push(pos + fvec2(+rad, -rad), color, fvec2(512-m,1024+m    ));
-        LightQueue::Push(pos + fvec2(-rad, +rad), color, fvec2(m    ,1024-m+512));
-        LightQueue::Push(pos + fvec2(-rad, +rad), color, fvec2(m    ,1024-m+512));
-        LightQueue::Push(pos + fvec2(+rad, -rad), color, fvec2(512-m,1024+m    ));
-        LightQueue::Push(pos + fvec2(+rad, +rad), color, fvec2(512-m,1024-m+512));
+        fvec4 color4 = color.to_vec4(0);
+        LightQueue::Attribs *v = LightQueue::AddQuads(1);
+        v[0] = {pos + fvec2(-rad, -rad), color4, fvec2(m    ,1024+m    )};
+        v[1] = {pos + fvec2(+rad, -rad), color4, fvec2(512-m,1024+m    )};
+        v[2] = {pos + fvec2(-rad, +rad), color4, fvec2(m    ,1024-m+512)};
+        v[3] = {pos + fvec2(+rad, +rad), color4, fvec2(512-m,1024-m+512)};
     }
 
     void Background(int index, ivec2 offset)
@@ -519,6 +673,11 @@ namespace Draw
         ShaderMain::uniforms.texture = Draw::texture_unit_main;
         ShaderMain::uniforms.color_matrix = fmat4();
 
+        ShaderSprite::uniforms.matrix = view_mat;
+        ShaderSprite::uniforms.tex_size = texture_main.Size();
+        ShaderSprite::uniforms.texture = Draw::texture_unit_main;
+        ShaderSprite::uniforms.color_matrix = fmat4();
+
         ShaderLight::uniforms.matrix = view_mat;
         ShaderLight::uniforms.tex_size = texture_main.Size();
         ShaderLight::uniforms.texture = Draw::texture_unit_main;
@@ -527,9 +686,6 @@ namespace Draw
         ShaderLightApply::uniforms.dither = Draw::texture_unit_dither;
         ShaderLightApply::uniforms.opacity = 0.9;
 
-        Queue::array.reserve(Queue::size);
-        LightQueue::array.reserve(Queue::size);
-
         Graphics::Blending::Enable();
         Graphics::Blending::FuncNormalPre();
     }
@@ -545,6 +701,7 @@ namespace Draw
         mouse.matrix = fmat3::translate(-win.Size()/2) * fmat3::scale(fvec3(1 / scale_factor));
     }
 }
+#endif
 using Draw::Tri;
 using Draw::Quad;
 using Draw::Text;
@@ -555,14 +712,20 @@ namespace Tiles
 {
     struct Data
     {
-        const char *name;
-        int tex_index;
-        bool solid;
-        bool slow;
+        const char *name = 0; // Null for unused indices.
+        int tex_index = 0;
+        bool solid = 0;
+        bool slow = 0;
     };
     constexpr int invis = std::numeric_limits<int>::max();
 
-    std::map<int, Data> map
+    struct Entry
+    {
+        int index;
+        Data data;
+    };
+
+    constexpr Entry list[]
     {
         {00,{"air"     ,invis,0,0}},
         {30,{"shadow"  ,2    ,0,0}},
@@ -572,19 +735,82 @@ namespace Tiles
         {50,{"stairs"  ,4    ,0,1}},
     };
 
+    constexpr int table_size = []
+    {
+        int ret = 0;
+        for (const auto &it : list)
+            ret = max(ret, it.index + 1);
+        return ret;
+    }();
+
+    constexpr std::array<Data, table_size> table = [] // Indexed by tile index.
+    {
+        std::array<Data, table_size> ret{};
+        for (const auto &it : list)
+            ret[it.index] = it.data;
+        return ret;
+    }();
+
     const Data &Info(int index)
     {
-        if (auto it = map.find(index); it != map.end())
-            return it->second;
-        else
+        if (index < 0 || index >= table_size || !table[index].name)
             Program::Error("Unknown tile index ", index, ".");
+        return table[index];
     }
 
     const std::vector<int> indices = []
     {
         std::vector<int> ret;
-        for (const auto &it : map)
-            ret.push_back(it.first);
+        for (const auto &it : list)
+            ret.push_back(it.index);
+        std::sort(ret.begin(), ret.end());
+        return ret;
+    }();
+
+    // Maps store tiles packed into one byte, `kind * variant_count + variant`. `kind` is the position in `list`.
+    // `variant` is `x + y * 3`, where each coordinate of the tile variant (-1, 0 or 1) is stored as `v mod 3`, so that packed 0 is air without a variant.
+    using packed_t = uint8_t;
+    constexpr int variant_count = 9;
+    static_assert(std::size(list) * variant_count <= 256, "Too many tiles to pack them into a byte.");
+    static_assert(list[0].index == 0, "Air must be the first tile, so that zeroed chunks contain air.");
+
+    constexpr std::array<int, table_size> kind_table = [] // Indexed by tile index, contains -1 for unused indices.
+    {
+        std::array<int, table_size> ret{};
+        for (auto &it : ret)
+            it = -1;
+        for (int i = 0; i < int(std::size(list)); i++)
+            ret[list[i].index] = i;
+        return ret;
+    }();
+
+    [[nodiscard]] packed_t Pack(int index, ivec2 variant)
+    {
+        Info(index); // Validate the index.
+        if ((abs(variant) > 1).any())
+            Program::Error("Invalid tile variant ", variant, ".");
+        ivec2 v = (variant + 3) % 3;
+        return kind_table[index] * variant_count + v.x + v.y * 3;
+    }
+    [[nodiscard]] inline int UnpackIndex(packed_t tile)
+    {
+        return list[tile / variant_count].index;
+    }
+    [[nodiscard]] inline ivec2 UnpackVariant(packed_t tile)
+    {
+        int x = tile % variant_count % 3, y = tile % variant_count / 3;
+        return ivec2(x == 2 ? -1 : x, y == 2 ? -1 : y);
+    }
+
+    // Changes when the tile list or the collision flags change. Binary maps store it to detect outdated tiles and collision bits.
+    constexpr uint32_t collision_hash = []
+    {
+        uint32_t ret = 2166136261;
+        for (const auto &it : list)
+        {
+            for (uint32_t value : {uint32_t(it.index), uint32_t(it.data.solid), uint32_t(it.data.slow)})
+                ret = (ret ^ value) * 16777619;
+        }
         return ret;
     }();
 
@@ -658,10 +884,342 @@ class Map
     Editor editor;
     std::string filename;
 
+    // Tiles are stored in square chunks. Each chunk also has one solid bit and one slow bit per tile, from `Tiles::Info()`.
+    inline static constexpr int chunk_size = 32, chunk_area = chunk_size * chunk_size, chunk_words = chunk_area / 64;
+    struct Chunk
+    {
+        Tiles::packed_t tiles[layer_count][chunk_area] {};
+        uint64_t solid_bits[layer_count][chunk_words] {}, slow_bits[layer_count][chunk_words] {};
+
+        [[nodiscard]] bool IsEmpty() const // Contains only air.
+        {
+            for (const auto &layer : tiles)
+            for (Tiles::packed_t tile : layer)
+            {
+                if (tile != 0)
+                    return 0;
+            }
+            return 1;
+        }
+
+        void UpdateBits(int layer, int index)
+        {
+            const auto &info = Tiles::Info(Tiles::UnpackIndex(tiles[layer][index]));
+            uint64_t mask = uint64_t(1) << (index % 64);
+            uint64_t &solid = solid_bits[layer][index / 64], &slow = slow_bits[layer][index / 64];
+            solid = info.solid ? solid | mask : solid & ~mask;
+            slow = info.slow ? slow | mask : slow & ~mask;
+        }
+    };
+
+    // Chunks of binary maps are loaded on demand, and the ones that weren't used recently are evicted, so the memory usage depends on the visited area rather than the map size.
+    // Chunks of text maps and chunks modified by the editor are pinned, and aren't evicted until the map is saved.
+    // Chunks that contain only air aren't allocated, they all point to `EmptyChunk()`.
+    // Several threads can load chunks at the same time, but `Evict()` must not run concurrently with anything else.
+    class ChunkCache
+    {
+        struct Entry
+        {
+            std::unique_ptr<Chunk> storage; // Null for unloaded and empty chunks.
+            std::atomic<const Chunk *> chunk = 0; // Set to `storage` or `EmptyChunk()` after it's loaded.
+            std::atomic<uint64_t> last_use = 0; // Updated on every access, so it doesn't need the mutex.
+            bool pinned = 0;
+        };
+
+        [[nodiscard]] static const Chunk *EmptyChunk()
+        {
+            static const Chunk ret{};
+            return &ret;
+        }
+
+        int count = 0;
+        std::unique_ptr<Entry[]> entries;
+        std::mutex mutex; // Locked when loading chunks.
+        int loaded_count = 0;
+        uint64_t time = 0;
+
+        void Swap(ChunkCache &other)
+        {
+            std::swap(count, other.count);
+            std::swap(entries, other.entries);
+            std::swap(loaded_count, other.loaded_count);
+            std::swap(time, other.time);
+        }
+
+      public:
+        ChunkCache() {}
+        ChunkCache(int count) : count(count), entries(std::make_unique<Entry[]>(count)) {}
+
+        ChunkCache(const ChunkCache &other) : ChunkCache(other.count)
+        {
+            for (int i = 0; i < count; i++)
+            {
+                const Entry &from = other.entries[i];
+                Entry &to = entries[i];
+                if (from.storage)
+                {
+                    to.storage = std::make_unique<Chunk>(*from.storage);
+                    to.chunk = to.storage.get();
+                }
+                else
+                {
+                    to.chunk = from.chunk.load();
+                }
+                to.last_use = from.last_use.load(std::memory_order_relaxed);
+                to.pinned = from.pinned;
+            }
+            loaded_count = other.loaded_count;
+            time = other.time;
+        }
+        ChunkCache(ChunkCache &&other) noexcept
+        {
+            Swap(other);
+        }
+        ChunkCache &operator=(ChunkCache other) noexcept
+        {
+            Swap(other);
+            return *this;
+        }
+
+        // Returns a chunk, loading it if necessary, and marks it as recently used. `load()` should return a `std::unique_ptr<Chunk>`, or null if the chunk is empty.
+        template <typename F> const Chunk &Get(int index, F &&load)
+        {
+            Entry &entry = entries[index];
+            entry.last_use.store(time, std::memory_order_relaxed);
+            if (const Chunk *ret = entry.chunk.load(std::memory_order_acquire))
+                return *ret;
+
+            std::lock_guard lock(mutex);
+            if (const Chunk *ret = entry.chunk.load(std::memory_order_relaxed))
+                return *ret;
+
+            entry.storage = load();
+            if (entry.storage)
+                loaded_count++;
+            entry.chunk.store(entry.storage ? entry.storage.get() : EmptyChunk(), std::memory_order_release);
+            return *entry.chunk.load(std::memory_order_relaxed);
+        }
+        template <typename F> Chunk &GetMutable(int index, F &&load) // Also pins the chunk.
+        {
+            Entry &entry = entries[index];
+            if (!entry.storage)
+            {
+                const Chunk &chunk = Get(index, load); // This loads non-empty chunks into `entry.storage`, and counts them.
+                if (!entry.storage) // Got the shared empty chunk, make a copy that can be modified.
+                {
+                    entry.storage = std::make_unique<Chunk>(chunk);
+                    entry.chunk = entry.storage.get();
+                    loaded_count++;
+                }
+            }
+            entry.pinned = 1;
+            return *entry.storage;
+        }
+
+        void ReleaseEmpty() // Frees the chunks that contain only air, even if they are pinned.
+        {
+            for (int i = 0; i < count; i++)
+            {
+                Entry &entry = entries[i];
+                if (entry.storage && entry.storage->IsEmpty())
+                {
+                    entry.chunk = EmptyChunk();
+                    entry.storage = 0;
+                    entry.pinned = 0;
+                    loaded_count--;
+                }
+            }
+        }
+
+        void UnpinAll() // Call this when the file that the chunks are loaded from has the current contents of all of them.
+        {
+            for (int i = 0; i < count; i++)
+                entries[i].pinned = 0;
+        }
+
+        // Starts a new time step, and evicts the chunks that were used least recently, until there are at most `max_count` of them (not counting the pinned ones).
+        void Evict(int max_count)
+        {
+            time++;
+
+            std::vector<int> candidates;
+            for (int i = 0; i < count; i++)
+            {
+                if (entries[i].storage && !entries[i].pinned)
+                    candidates.push_back(i);
+            }
+            if (int(candidates.size()) <= max_count)
+                return;
+
+            int evict_count = candidates.size() - max_count;
+            std::nth_element(candidates.begin(), candidates.begin() + evict_count, candidates.end(), [&](int a, int b){return entries[a].last_use.load(std::memory_order_relaxed) < entries[b].last_use.load(std::memory_order_relaxed);});
+            for (int i = 0; i < evict_count; i++)
+            {
+                Entry &entry = entries[candidates[i]];
+                entry.chunk = 0;
+                entry.storage = 0;
+                loaded_count--;
+            }
+        }
+
+        [[nodiscard]] int LoadedCount() const // Not counting the empty chunks.
+        {
+            return loaded_count;
+        }
+    };
+
+    inline static constexpr int max_loaded_chunks = 64; // Not counting the pinned ones.
+    inline static constexpr int stream_margin = 1; // Chunks are loaded this far outside of the screen.
+
+    ivec2 chunk_count = ivec2(0);
+    mutable ChunkCache chunks;
+
+    // Binary maps contain a header, then an offset of each chunk (`uint64_t`, 0 for empty chunks), then the non-empty chunks themselves, in their native layout.
+    // They are memory-mapped, and chunks are copied from there when needed, so loading a map takes the same time regardless of its size.
+    // The text format stays the source format: the editor saves both, and `--convert-map` makes a binary map from a text one.
+    // A binary map remembers the size and the modification time of its text map, and is ignored if the text map has changed since. Checking that doesn't read the text map.
+    // Copying the maps in a way that doesn't preserve modification times (e.g. a git checkout) makes the binary map stale, until it's saved again.
+    struct BinaryHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t collision_hash; // `Tiles::collision_hash` at the moment of saving.
+        uint64_t source_size, source_time; // `MemoryFile::info()` of the text map, or zeroes if there was none.
+        ivec2 size, spawn_tile, boss_tile;
+        int32_t chunk_size;
+    };
+    inline static constexpr char binary_magic[8] = "LD42map";
+    inline static constexpr uint32_t binary_version = 5;
+    static_assert(std::is_trivially_copyable_v<Chunk> && std::is_trivially_copyable_v<BinaryHeader>, "Those are stored in binary maps as is.");
+
+    MemoryFile binary_file; // Chunks are loaded from here. Empty for text maps.
+
+    [[nodiscard]] static std::size_t BinaryChunksOffset(ivec2 chunk_count)
+    {
+        return (sizeof(BinaryHeader) + chunk_count.prod() * sizeof(uint64_t) + 7) / 8 * 8;
+    }
+
+    [[nodiscard]] std::unique_ptr<Chunk> LoadChunk(int index) const // Returns null for empty chunks.
+    {
+        if (!binary_file) // Text maps have all non-empty chunks loaded and pinned.
+            return 0;
+        uint64_t offset;
+        std::memcpy(&offset, binary_file.data() + sizeof(BinaryHeader) + index * sizeof offset, sizeof offset);
+        if (offset == 0)
+            return 0;
+        if (offset < BinaryChunksOffset(chunk_count) || offset > binary_file.size() || binary_file.size() - offset < sizeof(Chunk))
+            Program::Error("Invalid chunk offset in binary map `", binary_file.name(), "`.");
+        auto ret = std::make_unique<Chunk>();
+        std::memcpy(ret.get(), binary_file.data() + offset, sizeof(Chunk));
+        return ret;
+    }
+
+    [[nodiscard]] int ChunkIndex(ivec2 tile_pos) const // `tile_pos` must be valid.
+    {
+        return tile_pos.y / chunk_size * chunk_count.x + tile_pos.x / chunk_size;
+    }
+    [[nodiscard]] static int IndexInChunk(ivec2 tile_pos) // `tile_pos` must be valid.
+    {
+        return tile_pos.y % chunk_size * chunk_size + tile_pos.x % chunk_size;
+    }
+    [[nodiscard]] const Chunk &GetChunk(int index) const
+    {
+        return chunks.Get(index, [&]{return LoadChunk(index);});
+    }
+    [[nodiscard]] Chunk &GetMutableChunk(int index)
+    {
+        return chunks.GetMutable(index, [&]{return LoadChunk(index);});
+    }
+
+    void SetSize(ivec2 new_size) // Removes all chunks.
+    {
+        size = new_size;
+        chunk_count = (size + chunk_size - 1) / chunk_size;
+        chunks = ChunkCache(chunk_count.prod());
+    }
+
+    // The reflection reads and writes the tile vectors, so those functions move or copy the tiles between them and the chunks.
+    void MoveTilesToChunks() // Pins all non-empty chunks.
+    {
+        for (int layer = 0; layer < layer_count; layer++)
+        {
+            auto &vec = this->*layers[layer];
+            for (int y = 0; y < size.y; y++)
+            for (int x = 0; x < size.x; x++)
+            {
+                Chunk &chunk = GetMutableChunk(ChunkIndex(ivec2(x,y)));
+                int index = IndexInChunk(ivec2(x,y));
+                chunk.tiles[layer][index] = Tiles::Pack(vec[y * size.x + x].n, vec[y * size.x + x].v);
+                chunk.UpdateBits(layer, index);
+            }
+            vec = {};
+        }
+        chunks.ReleaseEmpty();
+    }
+    void CopyTilesFromChunks() // Doesn't pin anything, the loaded chunks can be evicted later.
+    {
+        for (int layer = 0; layer < layer_count; layer++)
+        {
+            auto &vec = this->*layers[layer];
+            vec.resize(size.prod());
+            for (int y = 0; y < size.y; y++)
+            for (int x = 0; x < size.x; x++)
+                vec[y * size.x + x] = Get(ivec2(x,y), layer);
+        }
+    }
+
   public:
     bool enable_editor = 0;
 
-    static Map FromFile(std::string name)
+    [[nodiscard]] static std::string BinaryFileName(std::string text_file_name) // Replaces the extension with `.bin`.
+    {
+        auto dot = text_file_name.find_last_of('.');
+        if (dot != std::string::npos && text_file_name.find_first_of("/\\", dot) == std::string::npos)
+            text_file_name.resize(dot);
+        return text_file_name + ".bin";
+    }
+
+    static Map FromFile(std::string name) // `name` is a text map. If there is an up to date binary map next to it, that one is loaded instead.
+    {
+        if (auto ret = FromBinaryFile(BinaryFileName(name), MemoryFile::info(name)))
+        {
+            ret->filename = name;
+            return *ret;
+        }
+        return FromTextFile(name);
+    }
+    // Returns null if the file doesn't exist or can't be used, or if it doesn't match the text map described by `source`. If `source` is null, any text map is accepted.
+    [[nodiscard]] static std::optional<Map> FromBinaryFile(std::string name, std::optional<MemoryFile::Info> source)
+    {
+        if (FILE *file = std::fopen(name.c_str(), "rb"))
+            std::fclose(file);
+        else
+            return {};
+
+        Map ret{};
+        MemoryFile file = MemoryFile::map(name);
+
+        BinaryHeader header;
+        if (file.size() < sizeof header)
+            return {};
+        std::memcpy(&header, file.data(), sizeof header);
+        if (std::memcmp(header.magic, binary_magic, sizeof header.magic) != 0 || header.version != binary_version || header.collision_hash != Tiles::collision_hash)
+            return {};
+        if (source && (header.source_size != source->size || header.source_time != source->modification_time))
+            return {};
+        if ((header.size < 0).any() || header.chunk_size != chunk_size)
+            return {};
+
+        ret.SetSize(header.size);
+        if (file.size() < BinaryChunksOffset(ret.chunk_count))
+            return {};
+
+        ret.spawn_tile = header.spawn_tile;
+        ret.boss_tile = header.boss_tile;
+        ret.binary_file = file;
+        return ret;
+    }
+    static Map FromTextFile(std::string name)
     {
         Map ret{};
         auto file = MemoryFile(name);
@@ -688,9 +1246,11 @@ class Map
             Program::Error("Size mismatch in map `", name, "`.");
 
         ret.filename = name;
+        ret.SetSize(ret.size);
+        ret.MoveTilesToChunks();
         return ret;
     }
-    void Save() // Also makes a backup.
+    void Save() // Also makes a backup, and updates the binary map.
     {
         auto time = std::time(0);
         std::string time_string = std::asctime(std::localtime(&time));
@@ -699,8 +1259,69 @@ class Map
                 ch = '-';
         std::string backup_name = filename + "." + time_string + ".backup";
         std::rename(filename.c_str(), backup_name.c_str());
+
+        // The reflection works with the tile vectors, so the tiles are copied there temporarily. The chunks keep them too, so they are not touched.
+        CopyTilesFromChunks();
         std::string refl = Refl::Interface(*this).to_string();
+        for (auto la : layers)
+            this->*la = {};
+
         MemoryFile::Save(filename, (uint8_t*)refl.data(), (uint8_t*)refl.data() + refl.size());
+
+        // Now the binary map has all edits, so the chunks can be loaded from it again, and don't need to be pinned.
+        std::string binary_name = BinaryFileName(filename);
+        if (SaveBinary(binary_name))
+        {
+            binary_file = MemoryFile::map(binary_name);
+            chunks.UnpinAll();
+        }
+    }
+    // The binary map will be used only as long as the text map (`filename`) keeps its current size and modification time, so the text map must be saved first.
+    // The old file can be memory-mapped by this map or its copies, so it's never overwritten in place. Instead a new file is written and renamed over it.
+    // On Windows a mapped file can't be replaced. Then the old file stays, and gets ignored because the text map has changed.
+    bool SaveBinary(std::string name) const // Returns 0 if the old file couldn't be replaced.
+    {
+        BinaryHeader header{};
+        std::memcpy(header.magic, binary_magic, sizeof header.magic);
+        header.version = binary_version;
+        header.collision_hash = Tiles::collision_hash;
+        if (auto source = MemoryFile::info(filename))
+        {
+            header.source_size = source->size;
+            header.source_time = source->modification_time;
+        }
+        header.size = size;
+        header.spawn_tile = spawn_tile;
+        header.boss_tile = boss_tile;
+        header.chunk_size = chunk_size;
+
+        std::vector<uint8_t> data(BinaryChunksOffset(chunk_count));
+        std::memcpy(data.data(), &header, sizeof header);
+        for (int i = 0; i < chunk_count.prod(); i++)
+        {
+            const Chunk &chunk = GetChunk(i);
+            uint64_t offset = 0;
+            if (!chunk.IsEmpty())
+            {
+                offset = data.size();
+                data.resize(data.size() + sizeof(Chunk));
+                std::memcpy(data.data() + offset, &chunk, sizeof(Chunk));
+            }
+            std::memcpy(data.data() + sizeof header + i * sizeof offset, &offset, sizeof offset);
+        }
+
+        std::string temp_name = name + ".tmp";
+        MemoryFile::Save(temp_name, data.data(), data.data() + data.size());
+        if (std::rename(temp_name.c_str(), name.c_str()) != 0) // On Windows, this fails if the target exists.
+        {
+            std::remove(name.c_str());
+            if (std::rename(temp_name.c_str(), name.c_str()) != 0)
+            {
+                std::remove(temp_name.c_str());
+                return 0;
+            }
+        }
+        return 1;
     }
     void Reload()
     {
@@ -709,34 +1330,151 @@ class Map
         enable_editor = had_editor;
     }
 
-    ivec2 SpawnTile() const {return spawn_tile;}
-    ivec2 BossTile() const {return boss_tile;}
+    // Loads the chunks around the camera and evicts the ones that weren't used for a while. Call this once per tick.
+    // Chunks that are not loaded yet are loaded on the first access anyway, this only makes it happen in advance.
+    // Must not run concurrently with any other functions.
+    void Stream(ivec2 cam_pos) const
+    {
+        if (chunk_count.prod() == 0)
+            return;
+
+        ivec2 tile_a = PixelToTile(cam_pos - screen_sz/2), tile_b = PixelToTile(cam_pos + screen_sz/2);
+        ivec2 a = clamp(div_ex(tile_a, chunk_size) - stream_margin, ivec2(0), chunk_count - 1);
+        ivec2 b = clamp(div_ex(tile_b, chunk_size) + stream_margin, ivec2(0), chunk_count - 1);
+        for (int y = a.y; y <= b.y; y++)
+        for (int x = a.x; x <= b.x; x++)
+        {
+            (void)GetChunk(y * chunk_count.x + x);
+        }
+
+        chunks.Evict(max_loaded_chunks);
+    }
+    [[nodiscard]] int LoadedChunkCount() const
+    {
+        return chunks.LoadedCount();
+    }
+
+    ivec2 Size() const {return size;}
+    ivec2 SpawnTile() const {return spawn_tile;}
+    ivec2 BossTile() const {return boss_tile;}
+
+    ivec2 PixelToTile(ivec2 pix) const
+    {
+        return div_ex(pix, tile_size);
+    }
+
+    bool TilePosValid(ivec2 pos) const
+    {
+        return (pos >= 0).all() && (pos < size).all();
+    }
+
+    Tile Get(ivec2 pos, int layer) const
+    {
+        if (!TilePosValid(pos) || layer < 0 || layer >= layer_count)
+            return {};
+        Tiles::packed_t tile = GetChunk(ChunkIndex(pos)).tiles[layer][IndexInChunk(pos)];
+        return Tile(Tiles::UnpackIndex(tile), Tiles::UnpackVariant(tile));
+    }
+    void Set(ivec2 pos, int layer, const Tile &tile)
+    {
+        if (!TilePosValid(pos) || layer < 0 || layer >= layer_count)
+            return;
+        Chunk &chunk = GetMutableChunk(ChunkIndex(pos));
+        chunk.tiles[layer][IndexInChunk(pos)] = Tiles::Pack(tile.n, tile.v);
+        chunk.UpdateBits(layer, IndexInChunk(pos));
+    }
+
+    // Those are equivalent to `Tiles::Info(Get(pos, layer).n).solid` and `.slow`, but much faster.
+    [[nodiscard]] bool Solid(ivec2 pos, int layer) const
+    {
+        if (!TilePosValid(pos))
+            return 0;
+        int index = IndexInChunk(pos);
+        return GetChunk(ChunkIndex(pos)).solid_bits[layer][index / 64] >> (index % 64) & 1;
+    }
+    [[nodiscard]] bool Slow(ivec2 pos, int layer) const
+    {
+        if (!TilePosValid(pos))
+            return 0;
+        int index = IndexInChunk(pos);
+        return GetChunk(ChunkIndex(pos)).slow_bits[layer][index / 64] >> (index % 64) & 1;
+    }
+
+    struct RayHit
+    {
+        bool hit = 0;
+        float dist = 0; // If nothing was hit, this is the max distance.
+        fvec2 pos = fvec2(0); // In pixels.
+        ivec2 tile = ivec2(0); // The tile that was hit.
+        ivec2 normal = ivec2(0); // Points out of the side of the tile that was hit. Zero if the ray starts in a solid tile.
+    };
+
+    // Finds the first solid tile on the ray, visiting each tile it passes exactly once. Positions are in pixels, `dir` should be normalized.
+    [[nodiscard]] RayHit RayCast(fvec2 from, fvec2 dir, float max_dist, int layer) const
+    {
+        RayHit ret;
+
+        ivec2 tile = div_ex(ivec2(floor(from.x), floor(from.y)), tile_size);
+        if (Solid(tile, layer))
+        {
+            ret.hit = 1;
+            ret.pos = from;
+            ret.tile = tile;
+            return ret;
+        }
+
+        constexpr float inf = std::numeric_limits<float>::infinity();
+        ivec2 step(sign(dir.x), sign(dir.y));
+        fvec2 next_dist, delta_dist; // Distances to the next vertical and horizontal tile border, and between them.
+        for (int i = 0; i < 2; i++)
+        {
+            if (step[i] == 0)
+            {
+                next_dist[i] = delta_dist[i] = inf;
+                continue;
+            }
+            next_dist[i] = ((tile[i] + (step[i] > 0)) * tile_size[i] - from[i]) / dir[i];
+            delta_dist[i] = tile_size[i] / abs(dir[i]);
+        }
 
-    ivec2 PixelToTile(ivec2 pix)
-    {
-        return div_ex(pix, tile_size);
-    }
+        while (1)
+        {
+            int axis = next_dist.x < next_dist.y ? 0 : 1;
+            float dist = next_dist[axis];
+            if (dist > max_dist)
+                break;
 
-    bool TilePosValid(ivec2 pos) const
-    {
-        return (pos >= 0).all() && (pos < size).all();
-    }
+            tile[axis] += step[axis];
+            next_dist[axis] += delta_dist[axis];
 
-    Tile Get(ivec2 pos, int layer)
-    {
-        if (!TilePosValid(pos) || layer < 0 || layer >= layer_count)
-            return {};
-        return (this->*layers[layer])[size.x * pos.y + pos.x];
+            if (Solid(tile, layer))
+            {
+                ret.hit = 1;
+                ret.dist = dist;
+                ret.pos = from + dir * dist;
+                ret.tile = tile;
+                ret.normal[axis] = -step[axis];
+                return ret;
+            }
+        }
+
+        ret.dist = max_dist;
+        ret.pos = from + dir * max_dist;
+        return ret;
     }
-    void Set(ivec2 pos, int layer, const Tile &tile)
+    [[nodiscard]] RayHit SegmentCast(fvec2 from, fvec2 to, int layer) const
     {
-        if (!TilePosValid(pos) || layer < 0 || layer >= layer_count)
-            return;
-        (this->*layers[layer])[size.x * pos.y + pos.x] = tile;
+        float len = (to - from).len();
+        if (len == 0)
+            return RayCast(from, fvec2(0), 0, layer);
+        return RayCast(from, (to - from) / len, len, layer);
     }
 
     void Tick(ivec2 cam_pos)
     {
+        #ifdef HEADLESS
+        (void)cam_pos;
+        #else
         if (enable_editor)
         {
             // Get tile pos
@@ -815,9 +1553,10 @@ class Map
                     Reload();
             }
         }
+        #endif
     }
 
-    void Render(ivec2 cam_pos)
+    void Render(ivec2 cam_pos) const
     {
         ivec2 base_tile = PixelToTile(cam_pos);
         ivec2 half_extent = screen_sz/2 / tile_size + 1;
@@ -859,9 +1598,19 @@ class Map
 };
 
 
+// Rendering draws moving objects between their positions from the previous and the current tick, `t` is the fraction of a tick since the last one.
+// Jumps longer than `max_dist` (e.g. respawning) are not interpolated.
+[[nodiscard]] fvec2 InterpolatePos(fvec2 prev, fvec2 cur, float t, float max_dist = 64)
+{
+    if ((cur - prev).len_sqr() > max_dist * max_dist)
+        return cur;
+    return prev + (cur - prev) * t;
+}
+
 struct Player
 {
     fvec2 pos = fvec2(0);
+    fvec2 prev_pos = fvec2(0); // Only used for rendering.
     fvec2 vel = fvec2(0);
     fvec2 dir = fvec2(0,1);
 
@@ -907,6 +1656,7 @@ struct Boss
 
     fvec2 target_pos = fvec2(0);
     fvec2 pos = fvec2(0);
+    fvec2 prev_pos = fvec2(0); // Only used for rendering.
     int invin = 0;
 
     bool safe_shield = 1;
@@ -948,11 +1698,12 @@ struct Boss
     struct MagicOrb
     {
         fvec2 pos = fvec2(0);
+        fvec2 prev_pos = fvec2(0); // Only used for rendering.
         fvec2 target_pos = fvec2(0);
         int hp = 3;
         int invin = 0;
 
-        MagicOrb(fvec2 pos) : pos(pos), target_pos(pos) {}
+        MagicOrb(fvec2 pos) : pos(pos), prev_pos(pos), target_pos(pos) {}
     };
 
     std::vector<MagicOrb> magic_orb_list;
@@ -974,6 +1725,7 @@ struct World
     Boss b;
 
     fvec2 cam_pos = fvec2(0);
+    fvec2 prev_cam_pos = fvec2(0); // Only used for rendering.
     fvec2 cam_vel = fvec2(0);
     fvec2 cam_pos_i = fvec2(0);
 
@@ -990,7 +1742,7 @@ struct World
 
     bool enable_light = 0;
 
-    Map map;
+    CopyOnWrite<Map> map; // Shared between copies of the world, until the editor changes it.
 
     struct Bullet
     {
@@ -999,6 +1751,7 @@ struct World
 
         fvec2 pos;
         fvec2 vel;
+        fvec2 prev_pos = pos; // Only used for rendering.
 
         float LightSize() const
         {
@@ -1015,16 +1768,17 @@ struct World
             }
             return fvec3(1);
         }
-        void Render(ivec2 cam_pos) const
+        void Render(ivec2 cam_pos, float t) const
         {
             constexpr ivec2 size(32);
+            ivec2 pos = iround(InterpolatePos(prev_pos, this->pos, t));
             switch (type)
             {
               case player:
-                Quad(iround(pos) - cam_pos - size/2, size, Src4(ivec2(96,64), size, 1, 0));
+                Quad(pos - cam_pos - size/2, size, Src4(ivec2(96,64), size, 1, 0));
                 break;
               case crystal:
-                Quad(iround(pos) - cam_pos - size/2, size, Src4(ivec2(96+32,64), size, 1, 0));
+                Quad(pos - cam_pos - size/2, size, Src4(ivec2(96+32,64), size, 1, 0));
                 break;
             }
         }
@@ -1078,102 +1832,276 @@ struct World
         }
     };
 
-    std::deque<Bullet> bullet_list;
+    Pool<Bullet> bullet_list; // Removed bullets are compacted after all of them are updated.
 
-    void AddBullet(fvec2 pos, fvec2 vel, Bullet::Type type)
+    Pool<Bullet>::Handle AddBullet(fvec2 pos, fvec2 vel, Bullet::Type type)
     {
-        bullet_list.push_back(Bullet{type, pos, vel});
+        return bullet_list.Add(Bullet{type, pos, vel});
     }
 
-    struct Particle
+    struct ParticleList // A structure of arrays, so the update and rendering loops stream linearly through the fields they need. Removed elements leave spare capacity for new ones.
     {
-        fvec3 color;
-        float alpha, beta;
-        fvec2 pos;
-        float dir, av;
-        float speed;
-        float size;
-        int life;
-        int cur_life = 0;
+        std::vector<fvec3> color;
+        std::vector<float> alpha, beta; // Lights don't use these.
+        std::vector<fvec2> pos;
+        std::vector<fvec2> prev_pos; // Only used for rendering.
+        std::vector<float> dir, av;
+        std::vector<float> speed;
+        std::vector<float> size;
+        std::vector<int> life;
+        std::vector<int> cur_life;
+        std::vector<std::size_t> expired; // Used only during `Tick()`.
+
+        [[nodiscard]] std::size_t Count() const
+        {
+            return pos.size();
+        }
+
+        void Add(fvec3 new_color, float new_alpha, float new_beta, fvec2 new_pos, float new_dir, float new_av, float new_speed, float new_size, int new_life)
+        {
+            color.push_back(new_color);
+            alpha.push_back(new_alpha);
+            beta.push_back(new_beta);
+            pos.push_back(new_pos);
+            prev_pos.push_back(new_pos);
+            dir.push_back(new_dir);
+            av.push_back(new_av);
+            speed.push_back(new_speed);
+            size.push_back(new_size);
+            life.push_back(new_life);
+            cur_life.push_back(0);
+        }
+
+        void Tick() // Ages and moves all particles, then removes expired ones. The order of the remaining ones is preserved.
+        {
+            std::size_t count = Count();
+            prev_pos = pos;
+            FastTrig::MoveAlongAngles(count, pos.data()->as_array(), dir.data(), av.data(), speed.data());
+
+            expired.resize(count);
+            std::size_t expired_count = FastTrig::AgeAndFindExpired(count, cur_life.data(), life.data(), expired.data());
+            if (expired_count == 0)
+                return;
+
+            // Move the runs of particles between the expired ones down, over the gaps.
+            std::size_t out = expired[0];
+            for (std::size_t e = 0; e < expired_count; e++)
+            {
+                std::size_t begin = expired[e] + 1, end = e + 1 < expired_count ? expired[e+1] : count;
+                auto Move = [&](auto &vec){std::copy(vec.begin() + begin, vec.begin() + end, vec.begin() + out);};
+                Move(color);
+                Move(alpha);
+                Move(beta);
+                Move(pos);
+                Move(prev_pos);
+                Move(dir);
+                Move(av);
+                Move(speed);
+                Move(size);
+                Move(life);
+                Move(cur_life);
+                out += end - begin;
+            }
+            Resize(out);
+            expired.clear(); // Keeps the capacity, but makes copying the list cheaper.
+        }
+
+        void Resize(std::size_t count) // Only shrinking makes sense. Capacity is kept.
+        {
+            color.resize(count);
+            alpha.resize(count);
+            beta.resize(count);
+            pos.resize(count);
+            prev_pos.resize(count);
+            dir.resize(count);
+            av.resize(count);
+            speed.resize(count);
+            size.resize(count);
+            life.resize(count);
+            cur_life.resize(count);
+        }
     };
 
-    std::deque<Particle> particle_list;
+    ParticleList particle_list;
 
     void AddParticle(fvec3 color, float alpha, float beta, fvec2 pos, float dir, float av, float speed, float size, int life)
     {
-        Particle tmp;
-        tmp.color = color;
-        tmp.alpha = alpha;
-        tmp.beta = beta;
-        tmp.pos = pos;
-        tmp.dir = dir;
-        tmp.av = av;
-        tmp.speed = speed;
-        tmp.size = size;
-        tmp.life = life;
-        particle_list.push_back(tmp);
+        particle_list.Add(color, alpha, beta, pos, dir, av, speed, size, life);
     }
 
 
-    struct Light
-    {
-        fvec3 color;
-        fvec2 pos;
-        float dir, av;
-        float speed;
-        float size;
-        int life;
-        int cur_life = 0;
-    };
-
-    std::deque<Light> light_list;
+    ParticleList light_list;
 
     void AddLight(fvec3 color, fvec2 pos, float dir, float av, float speed, float size, int life)
     {
-        Light tmp;
-        tmp.color = color;
-        tmp.pos = pos;
-        tmp.dir = dir;
-        tmp.av = av;
-        tmp.speed = speed;
-        tmp.size = size;
-        tmp.life = life;
-        light_list.push_back(tmp);
+        light_list.Add(color, 1, 0, pos, dir, av, speed, size, life);
     }
 
 
     void LoadMap(std::string name)
     {
         map = Map::FromFile("assets/" + name);
-        p.pos = map.SpawnTile() * tile_size + tile_size/2;
+        p.pos = map->SpawnTile() * tile_size + tile_size/2;
         cam_pos = p.pos;
         cam_pos_i = iround(cam_pos);
         b.pos = b.target_pos = BossHome();
+        SavePrevPositions();
+    }
+
+    void SavePrevPositions() // Rendering interpolates from those. Bullets and particles save their positions themselves when they move.
+    {
+        p.prev_pos = p.pos;
+        b.prev_pos = b.pos;
+        for (auto &orb : b.magic_orb_list)
+            orb.prev_pos = orb.pos;
+        prev_cam_pos = cam_pos;
     }
 
-    bool Solid(ivec2 pos, const std::vector<ivec2> &hitbox)
+    struct Hitbox // A box relative to the object position, in pixels. Both corners are inclusive.
+    {
+        ivec2 a, b;
+    };
+
+    bool Solid(ivec2 pos, Hitbox hitbox) const
     {
-        for (const auto &offset : hitbox)
+        ivec2 a = map->PixelToTile(pos + hitbox.a), b = map->PixelToTile(pos + hitbox.b);
+        for (int y = a.y; y <= b.y; y++)
+        for (int x = a.x; x <= b.x; x++)
         {
-            if (Tiles::Info(map.Get(map.PixelToTile(pos + offset), 2).n).solid)
+            if (map->Solid(ivec2(x,y), 2))
                 return 1;
         }
         return 0;
     }
-    bool Slowed(ivec2 pos, const std::vector<ivec2> &hitbox)
+    bool Slowed(ivec2 pos, Hitbox hitbox) const
     {
-        for (const auto &offset : hitbox)
+        ivec2 a = map->PixelToTile(pos + hitbox.a), b = map->PixelToTile(pos + hitbox.b);
+        for (int y = a.y; y <= b.y; y++)
+        for (int x = a.x; x <= b.x; x++)
         {
-            if (Tiles::Info(map.Get(map.PixelToTile(pos + offset), 0).n).slow)
+            if (map->Slow(ivec2(x,y), 0))
                 return 1;
         }
         return 0;
     }
 
+    // Moves a hitbox by `delta`, first along X and then along Y, stopping at solid tiles. Blocking one axis doesn't stop the other one, so objects slide along walls.
+    // This is what moving in tiny steps and rejecting the steps that end up in a wall would do, but it only looks at the tiles the leading edge crosses.
+    fvec2 Move(fvec2 pos, fvec2 delta, Hitbox hitbox) const
+    {
+        for (int axis = 0; axis < 2; axis++)
+        {
+            if (delta[axis] == 0)
+                continue;
+
+            fvec2 target = pos;
+            target[axis] += delta[axis];
+
+            if (Solid(iround(pos), hitbox)) // Already in a wall, only accept moves that get us out.
+            {
+                if (!Solid(iround(target), hitbox))
+                    pos = target;
+                continue;
+            }
+
+            int dir = sign(delta[axis]), other = 1 - axis;
+            int edge_offset = dir > 0 ? hitbox.b[axis] : hitbox.a[axis];
+            int tile = div_ex(iround(pos)[axis] + edge_offset, tile_size[axis]), target_tile = div_ex(iround(target)[axis] + edge_offset, tile_size[axis]);
+            ivec2 band_a = map->PixelToTile(iround(pos) + hitbox.a), band_b = map->PixelToTile(iround(pos) + hitbox.b); // Tiles covered by the hitbox across the movement direction.
+
+            for (int t = tile + dir; t != target_tile + dir; t += dir)
+            {
+                bool blocked = 0;
+                for (int o = band_a[other]; o <= band_b[other]; o++)
+                {
+                    ivec2 tile_pos;
+                    tile_pos[axis] = t;
+                    tile_pos[other] = o;
+                    if (map->Solid(tile_pos, 2))
+                    {
+                        blocked = 1;
+                        break;
+                    }
+                }
+                if (blocked)
+                {
+                    int last_free_pixel = dir > 0 ? t * tile_size[axis] - 1 : (t + 1) * tile_size[axis];
+                    float contact = last_free_pixel - edge_offset;
+                    target[axis] = dir > 0 ? max(pos[axis], contact) : min(pos[axis], contact);
+                    break;
+                }
+            }
+
+            pos = target;
+        }
+        return pos;
+    }
+
     fvec2 BossHome() const
     {
-        return map.BossTile() * tile_size + tile_size/2;
+        return map->BossTile() * tile_size + tile_size/2;
+    }
+};
+
+struct Controls // Input state for a single tick. `Tick()` reads the keyboard only through this, so it can be driven without a window.
+{
+    enum Button {move_up, move_down, move_left, move_right, fire, dash, any_key, _count};
+
+    uint8_t down_mask = 0, pressed_mask = 0;
+
+    [[nodiscard]] bool down(Button b) const {return down_mask >> b & 1;}
+    [[nodiscard]] bool pressed(Button b) const {return pressed_mask >> b & 1;}
+
+    void Set(Button b, bool is_down, bool is_pressed)
+    {
+        down_mask = (down_mask & ~(1 << b)) | is_down << b;
+        pressed_mask = (pressed_mask & ~(1 << b)) | is_pressed << b;
+    }
+
+    #ifndef HEADLESS
+    static Controls FromWindow(const World &w)
+    {
+        const Interface::Button *buttons[] = {&w.button_up, &w.button_down, &w.button_left, &w.button_right, &w.button_fire, &w.button_dash};
+        static_assert(std::extent_v<decltype(buttons)> == any_key);
+
+        Controls ret;
+        for (int i = 0; i < any_key; i++)
+            ret.Set(Button(i), buttons[i]->down(), buttons[i]->pressed());
+        ret.Set(any_key, 0, Interface::Button().AssignKey());
+        return ret;
+    }
+    #else
+    static Controls Autopilot(const World &w, uint64_t tick) // A crude scripted player. It walks to the nearest target, strafes around it, shoots and dashes.
+    {
+        Controls ret;
+
+        fvec2 target = w.b.pos;
+        auto Consider = [&](fvec2 pos)
+        {
+            if (target == w.b.pos || (pos - w.p.Center()).len() < (target - w.p.Center()).len())
+                target = pos;
+        };
+        for (const auto &it : w.b.crystal_list)
+            Consider(it.pos);
+        for (const auto &it : w.b.magic_orb_list)
+            Consider(it.pos);
+
+        fvec2 delta = target - w.p.Center();
+        ivec2 dir = iround(delta.norm() * 1.2); // Rounds to one of 8 directions.
+        bool aiming = tick % 10 == 0; // Facing the target for one tick is enough to aim, and doesn't move us much.
+        if (!aiming && delta.len() < 100)
+            dir = dir.rot90(tick / 120 % 2 * 2 + 1);
+
+        ret.Set(move_up, dir.y < 0, 0);
+        ret.Set(move_down, dir.y > 0, 0);
+        ret.Set(move_left, dir.x < 0, 0);
+        ret.Set(move_right, dir.x > 0, 0);
+        ret.Set(fire, 0, aiming);
+        ret.Set(dash, 0, tick % 90 == 0);
+        ret.Set(any_key, 0, tick % 60 == 0);
+        return ret;
     }
+    #endif
 };
 
 int death_counter = 0;
@@ -1181,7 +2109,77 @@ int min_y = 9000;
 bool game_started = 0;
 uint64_t game_timer = 0;
 
-int main(int, char**)
+namespace Replay // A recording stores the random seed and `Controls` for every tick, which is enough to reproduce a game session exactly.
+{
+    const std::string magic = "LD42 replay 3\n";
+
+    struct Recording
+    {
+        uint32_t seed = 0;
+        std::vector<Controls> ticks;
+
+        void Save(std::string file_name) const // Throws on failure.
+        {
+            std::vector<uint8_t> data(magic.begin(), magic.end());
+            for (int i = 0; i < 4; i++)
+                data.push_back(seed >> i*8 & 0xff);
+            for (const Controls &it : ticks)
+            {
+                data.push_back(it.down_mask);
+                data.push_back(it.pressed_mask);
+            }
+            MemoryFile::SaveCompressed(file_name, data.data(), data.data() + data.size());
+        }
+
+        [[nodiscard]] static Recording FromFile(std::string file_name) // Throws on failure.
+        {
+            MemoryFile file = MemoryFile(file_name).uncompress();
+            const uint8_t *ptr = file.begin();
+
+            if (file.size() < magic.size() + 4 || (file.size() - magic.size() - 4) % 2 != 0 || !std::equal(magic.begin(), magic.end(), ptr))
+                Program::Error("`", file_name, "` is not a valid replay.");
+            ptr += magic.size();
+
+            Recording ret;
+            for (int i = 0; i < 4; i++)
+                ret.seed |= uint32_t(*ptr++) << i*8;
+            ret.ticks.resize((file.end() - ptr) / 2);
+            for (Controls &it : ret.ticks)
+            {
+                it.down_mask = *ptr++;
+                it.pressed_mask = *ptr++;
+            }
+            return ret;
+        }
+    };
+
+    [[nodiscard]] uint32_t Checksum(const World &w) // FNV-1a of the key parts of the game state. Replaying the same recording must always produce the same value.
+    {
+        uint32_t ret = 2166136261;
+        auto Add = [&](const auto &value)
+        {
+            const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&value);
+            for (std::size_t i = 0; i < sizeof value; i++)
+                ret = (ret ^ bytes[i]) * 16777619;
+        };
+        Add(w.p.pos);
+        Add(w.p.vel);
+        Add(w.p.dead);
+        Add(w.b.pos);
+        Add(w.b.phase);
+        Add(w.b.phase_time);
+        Add(w.b.crystal_list.size());
+        Add(w.b.magic_orb_list.size());
+        Add(w.bullet_list.AliveCount());
+        Add(w.particle_list.Count());
+        Add(w.light_list.Count());
+        Add(death_counter);
+        Add(game_timer);
+        return ret;
+    }
+}
+
+int main(int argc, char **argv)
 {
     constexpr float
         plr_vel_step = 0.35, plr_vel_cap = 2.2, crystal_dist = 215, crystal_dist_2 = 170, crystal_anim_offset = 2, plr_bullet_speed = 4,
@@ -1189,9 +2187,7 @@ int main(int, char**)
         dark_force_step = 0.004, dark_force_max_dist = 200, boss_laser_offset = 20, boss_laser_hitbox_w = 10, boss_hitbox_rad = 18, orb_hitbox_rad = 9;
     constexpr int
         plr_anim_frame_len = 10, crystal_anim_period = 180, plr_fire_cooldown = 18, plr_fire_len = 8, enemy_invin_frames = 20, plr_dash_cooldown = 30, plr_dash_len = 8;
-    const std::vector<ivec2> plr_hitbox = {ivec2(-3,-3), ivec2(-3,2), ivec2(2,2), ivec2(2,-3)},
-                             bullet_hitbox = {ivec2(-2,-2), ivec2(-2,1), ivec2(1,1), ivec2(1,-2)},
-                             point_hitbox = {ivec2(0)};
+    constexpr World::Hitbox plr_hitbox{ivec2(-3), ivec2(2)}, bullet_hitbox{ivec2(-2), ivec2(1)};
 
     const std::vector<std::string> death_messages
     {
@@ -1208,26 +2204,153 @@ int main(int, char**)
         "It ain't easy",
     };
 
+    std::string record_file, replay_file;
+    #ifdef HEADLESS
+    uint64_t tick_count = 60 * 60 * 10; // Ten minutes of game time by default.
+    #endif
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--record" && i+1 < argc)
+        {
+            record_file = argv[++i];
+        }
+        else if (arg == "--replay" && i+1 < argc)
+        {
+            replay_file = argv[++i];
+        }
+        else if (arg == "--seed" && i+1 < argc)
+        {
+            Rand::Seed(std::strtoul(argv[++i], 0, 10));
+        }
+        else if (arg == "--convert-map" && i+1 < argc)
+        {
+            std::string name = argv[++i];
+            Map::FromTextFile(name).SaveBinary(Map::BinaryFileName(name));
+            return 0;
+        }
+        else if (arg == "--benchmark-parser" && i+1 < argc)
+        {
+            auto file = MemoryFile(argv[++i]);
+            std::string text(file.begin(), file.end());
+
+            constexpr int iterations = 50;
+            auto Report = [&](std::string action, uint64_t time, std::size_t bytes)
+            {
+                double seconds = Clock::TicksToSeconds(time);
+                std::cout << iterations << " " << action << "s in " << seconds << " s, " << std::fixed << std::setprecision(1)
+                          << bytes * iterations / seconds / 1000000 << " MB/s, " << seconds / iterations * 1000 << " ms per " << action << '\n' << std::defaultfloat << std::setprecision(6);
+            };
+
+            uint64_t start_time = Clock::Time();
+            for (int j = 0; j < iterations; j++)
+            {
+                Map map;
+                Refl::Interface(map).from_string(text);
+            }
+            Report("parse", Clock::Time() - start_time, text.size());
+
+            Map map;
+            Refl::Interface(map).from_string(text);
+            std::string output;
+            start_time = Clock::Time();
+            for (int j = 0; j < iterations; j++)
+            {
+                output.clear();
+                Refl::Interface(map).to_string_low(output);
+            }
+            Report("write", Clock::Time() - start_time, output.size());
+            return 0;
+        }
+        #ifdef HEADLESS
+        else if (arg.size() && arg[0] != '-')
+        {
+            tick_count = std::strtoull(arg.c_str(), 0, 10);
+        }
+        #endif
+        else
+        {
+            Program::Error("Unknown argument: `", arg, "`.");
+        }
+    }
+
+    Replay::Recording replay, recording;
+    if (replay_file.size())
+    {
+        replay = Replay::Recording::FromFile(replay_file);
+        Rand::Seed(replay.seed);
+    }
+    recording.seed = Rand::Seed();
+
+    #ifndef HEADLESS
     mouse.HideCursor();
+    #endif
 
     World w;
     w.LoadMap("map.txt");
 
-    World saved_world = w;
+    World saved_world = w; // The map is shared with `w`, so this and other snapshots only copy the moving objects.
+
+    // Recent snapshots for the rewind cheat. Slots are reused, so after the buffer fills up, taking a snapshot doesn't allocate.
+    struct Snapshot
+    {
+        World world;
+
+        // The state outside of `World` that has to match it.
+        int death_counter = 0, min_y = 0;
+        bool game_started = 0;
+        uint64_t game_timer = 0;
+        Rand::generator_t gameplay_generator, vfx_generator;
+
+        void Take(const World &w)
+        {
+            world = w;
+            death_counter = ::death_counter;
+            min_y = ::min_y;
+            game_started = ::game_started;
+            game_timer = ::game_timer;
+            gameplay_generator = Rand::gameplay;
+            vfx_generator = Rand::vfx;
+        }
+        void Restore(World &w) const
+        {
+            w = world;
+            ::death_counter = death_counter;
+            ::min_y = min_y;
+            ::game_started = game_started;
+            ::game_timer = game_timer;
+            Rand::gameplay = gameplay_generator;
+            Rand::vfx = vfx_generator;
+        }
+    };
+    constexpr int snapshot_period = 30, snapshot_count = 20; // The last 10 seconds.
+    RingBuffer<Snapshot> snapshots(debug_mode ? snapshot_count : 1);
+
+    // Broadphase for bullet collisions. Those are rebuilt when needed, so they are not a part of `World`.
+    UniformGrid bullet_grid(fvec2(0), w.map->Size() * tile_size, 32), enemy_grid = bullet_grid;
 
+    #ifndef HEADLESS
     if (fullscreen)
         win.SetMode(Interface::Window::fullscreen);
+    #endif
 
-    auto Tick = [&]
+    auto Tick = [&](const Controls &ctl)
     {
+        Rand::GeneratorOverride vfx_generator_override(Rand::vfx); // Most of the randomness here is cosmetic. Things that affect the gameplay use `Rand::gameplay` explicitly.
+
+        w.SavePrevPositions();
+
         { // Meta
+            #ifndef HEADLESS
             if (Interface::Button(Interface::Inputs::f11).pressed())
             {
                 fullscreen = !fullscreen;
                 win.SetMode(fullscreen ? Interface::Window::fullscreen : Interface::Window::windowed);
             }
+            #endif
 
-            if (!game_started && metronome.ticks > 30 && Interface::Button().AssignKey())
+            if (!game_started && metronome.ticks > 30 && ctl.pressed(Controls::any_key))
             {
                 game_started = 1;
                 Sounds::click(w.p.pos);
@@ -1266,26 +2389,35 @@ int main(int, char**)
 
             w.p.dead = 1;
             w.whiteness = 1;
-            w.p.death_msg_index = random_int(death_messages.size());
-
-            for (int i = 0; i < 24; i++)
-            {
-                float c = random_real_range(0,1);
-                w.AddParticle(fvec3(c, 4/5. + 1/5. * c, 1), 1, 0.5, w.p.Center() + fvec2::dir(random_real_range(f_pi), 4), random_real_range(f_pi), random_real_range(0.2),
-                              random_real_range(0.2,2), random_real_range(2,6), random_int_range(30,80));
-            }
+            w.p.death_msg_index = random_int(Rand::gameplay, death_messages.size());
+
+            constexpr int particle_count = 24;
+            float c[particle_count], offset_angle[particle_count], angle[particle_count], av[particle_count], speed[particle_count], size[particle_count];
+            int life[particle_count];
+            fill_random_real_range<float>(c, std::end(c), 0, 1);
+            fill_random_real_range<float>(offset_angle, std::end(offset_angle), -f_pi, f_pi);
+            fill_random_real_range<float>(angle, std::end(angle), -f_pi, f_pi);
+            fill_random_real_range<float>(av, std::end(av), -0.2, 0.2);
+            fill_random_real_range<float>(speed, std::end(speed), 0.2, 2);
+            fill_random_real_range<float>(size, std::end(size), 2, 6);
+            fill_random_int_range<int>(life, std::end(life), 30, 80);
+            for (int i = 0; i < particle_count; i++)
+                w.AddParticle(fvec3(c[i], 4/5. + 1/5. * c[i], 1), 1, 0.5, w.p.Center() + fvec2::dir(offset_angle[i], 4), angle[i], av[i], speed[i], size[i], life[i]);
         };
 
         { // Map
-            w.map.Tick(w.cam_pos_i);
+            w.map->Stream(w.cam_pos_i);
+
+            if (w.map->enable_editor)
+                w.map.Mut().Tick(w.cam_pos_i);
 
             if (debug_mode && Interface::Button(Interface::Inputs::grave).pressed())
-                w.map.enable_editor = !w.map.enable_editor;
+                w.map.Mut().enable_editor = !w.map->enable_editor;
         }
 
         { // Player
             // Get input direction
-            ivec2 dir = ivec2(w.button_right.down() - w.button_left.down(), w.button_down.down() - w.button_up.down());
+            ivec2 dir = ivec2(ctl.down(Controls::move_right) - ctl.down(Controls::move_left), ctl.down(Controls::move_down) - ctl.down(Controls::move_up));
             if (w.p.dead) dir = ivec2(0);
 
             { // Update animation
@@ -1331,7 +2463,7 @@ int main(int, char**)
                 {
                     if (w.p.dash_cooldown == 0)
                     {
-                        if (w.button_dash.pressed())
+                        if (ctl.pressed(Controls::dash))
                         {
                             w.p.dash_cooldown = plr_dash_cooldown;
                             w.p.dash_len = plr_dash_len;
@@ -1362,7 +2494,7 @@ int main(int, char**)
                     float vel_cap = plr_vel_cap;
                     if (w.Slowed(w.p.pos, plr_hitbox))
                         vel_cap *= 0.6;
-                    if (w.map.enable_editor)
+                    if (w.map->enable_editor)
                         vel_cap *= 3;
 
                     w.p.vel += dir * plr_vel_step;
@@ -1386,7 +2518,7 @@ int main(int, char**)
                     if (w.p.fire_cooldown)
                         w.p.fire_cooldown--;
 
-                    if (w.button_fire.pressed() && w.p.fire_cooldown == 0)
+                    if (ctl.pressed(Controls::fire) && w.p.fire_cooldown == 0)
                     {
                         Sounds::player_shoots(w.p.Center() + w.p.dir * 20);
                         w.p.fire_cooldown = plr_fire_cooldown;
@@ -1413,23 +2545,15 @@ int main(int, char**)
             { // Update position
                 if (!w.p.dead)
                 {
-                    constexpr float step = 0.7;
-                    fvec2 vel_norm = w.p.vel.norm();
-                    for (float s = w.p.vel.len(); s >= 0; s -= step)
-                    {
-                        float t = min(s, step);
-                        fvec2 v = vel_norm * t;
-
-                        if (!w.Solid(iround(w.p.pos.add_x(v.x)), plr_hitbox) || w.map.enable_editor)
-                            w.p.pos.x += v.x;
-                        if (!w.Solid(iround(w.p.pos.add_y(v.y)), plr_hitbox) || w.map.enable_editor)
-                            w.p.pos.y += v.y;
-                    }
+                    if (w.map->enable_editor)
+                        w.p.pos += w.p.vel;
+                    else
+                        w.p.pos = w.Move(w.p.pos, w.p.vel, plr_hitbox);
                 }
             }
 
             { // Update audio pos
-                Audio::ListenerPos(w.p.Center().to_vec3(-250));
+                Sounds::ListenerPos(w.p.Center().to_vec3(-250));
             }
 
             { // Death effects
@@ -1504,8 +2628,8 @@ int main(int, char**)
                     if (boss.phase_time == 1)
                     {
                         w.target_light_rad = 300;
-                        boss.first_prep_dir = fvec2(1,0).rot90(random_int(4));
-                        boss.first_rot_sign = random_sign();
+                        boss.first_prep_dir = fvec2(1,0).rot90(random_int(Rand::gameplay, 4));
+                        boss.first_rot_sign = random_sign(Rand::gameplay);
                         boss.safe_shield = 1;
                         Sounds::boss_shield(boss.pos);
                     }
@@ -1731,12 +2855,20 @@ int main(int, char**)
                         boss.dead = 1;
                         boss.magic_shield = 0;
 
-                        for (int i = 0; i < 64; i++)
+                        constexpr int particle_count = 64;
+                        float c[particle_count], offset[particle_count*2], angle[particle_count], av[particle_count], speed[particle_count], size[particle_count];
+                        int life[particle_count];
+                        fill_random_real_range<float>(c, std::end(c), 0, 1);
+                        fill_random_real_range<float>(offset, std::end(offset), -8, 8);
+                        fill_random_real_range<float>(angle, std::end(angle), -f_pi, f_pi);
+                        fill_random_real_range<float>(av, std::end(av), -0.2, 0.2);
+                        fill_random_real_range<float>(speed, std::end(speed), 0.5, 8);
+                        fill_random_real_range<float>(size, std::end(size), 22, 50);
+                        fill_random_int_range<int>(life, std::end(life), 120, 200);
+                        for (int i = 0; i < particle_count; i++)
                         {
-                            float c = random_real_range(0,1);
-                            fvec3 color(1, 0.6+c*0.4, 0.2+c*0.8);
-                            w.AddParticle(color, 1, 0.5, boss.pos + fvec2(random_real_range(8), random_real_range(8)), random_real_range(f_pi), random_real_range(0.2),
-                                          random_real_range(0.5,8), random_real_range(22,50), random_int_range(120,200));
+                            fvec3 color(1, 0.6+c[i]*0.4, 0.2+c[i]*0.8);
+                            w.AddParticle(color, 1, 0.5, boss.pos + fvec2(offset[i*2], offset[i*2+1]), angle[i], av[i], speed[i], size[i], life[i]);
                         }
                     }
 
@@ -1812,24 +2944,8 @@ int main(int, char**)
                 }
 
                 { // Fire laser
-                    fvec2 laser_dir = fvec2::dir(boss.first_laser_angle);
-                    fvec2 laser_end = boss.pos;
-                    float laser_step = 6;
-                    for (int i = 0; i < 1000; i++)
-                    {
-                        fvec2 test = laser_end + laser_dir * laser_step;
-                        if (w.Solid(test, point_hitbox))
-                        {
-                            laser_step /= 2;
-                            if (laser_step < 0.05)
-                                break;
-                        }
-                        else
-                        {
-                            laser_end = test;
-                        }
-                    }
-                    boss.first_laser_len = (laser_end - boss.pos).len();
+                    constexpr float max_laser_len = 6000;
+                    boss.first_laser_len = w.map->RayCast(boss.pos, fvec2::dir(boss.first_laser_angle), max_laser_len, 2).dist;
                 }
 
                 { // Laser particles
@@ -1895,6 +3011,9 @@ int main(int, char**)
 
             constexpr float shield_rad = 48;
 
+            if (boss.safe_shield || boss.magic_shield)
+                bullet_grid.Build(w.bullet_list.Size(), [&](std::size_t i){return w.bullet_list[i].pos;});
+
             { // Safe shield
 
                 if (boss.safe_shield)
@@ -1918,17 +3037,18 @@ int main(int, char**)
                     }
 
                     // Deflect bullets
-                    for (auto &it : w.bullet_list)
+                    bullet_grid.Query(boss.pos, shield_rad, [&](std::size_t index)
                     {
+                        auto &it = w.bullet_list[index];
                         fvec2 delta = boss.pos - it.pos;
                         if (delta.len() > shield_rad)
-                            continue;
+                            return;
                         if (it.vel /dot/ delta < 0)
-                            continue;
+                            return;
                         delta = delta.norm();
                         it.vel -= it.vel /dot/ delta * delta * 2;
                         Sounds::stopped_by_shield(boss.pos);
-                    }
+                    });
                 }
             }
 
@@ -1963,17 +3083,18 @@ int main(int, char**)
                         }
 
                         // Deflect bullets
-                        for (auto &it : w.bullet_list)
+                        bullet_grid.Query(boss.pos, shield_rad, [&](std::size_t index)
                         {
+                            auto &it = w.bullet_list[index];
                             fvec2 delta = boss.pos - it.pos;
                             if (delta.len() > shield_rad)
-                                continue;
+                                return;
                             if (it.vel /dot/ delta < 0)
-                                continue;
+                                return;
                             delta = delta.norm();
                             it.vel -= it.vel /dot/ delta * delta * 2;
                             Sounds::stopped_by_shield(boss.pos);
-                        }
+                        });
                     }
                 }
 
@@ -2035,9 +3156,25 @@ int main(int, char**)
         }
 
         { // Bullets
-            auto it = w.bullet_list.begin();
-            while (it != w.bullet_list.end())
+            constexpr float enemy_hit_dist = 14;
+
+            // Crystals and orbs don't move while bullets are processed, so the grid is rebuilt only when one of them is destroyed.
+            // Crystal `i` has index `i` in the grid, and orb `i` has index `crystal_list.size() + i`.
+            auto BuildEnemyGrid = [&]
+            {
+                enemy_grid.Build(boss.crystal_list.size() + boss.magic_orb_list.size(), [&](std::size_t i)
+                {
+                    return i < boss.crystal_list.size() ? fvec2(boss.crystal_list[i].pos) : boss.magic_orb_list[i - boss.crystal_list.size()].pos;
+                });
+            };
+            BuildEnemyGrid();
+
+            for (std::size_t index = 0; index < w.bullet_list.Size(); index++)
             {
+                auto it = &w.bullet_list[index];
+
+                it->prev_pos = it->pos;
+                fvec2 old_pos = it->pos;
                 it->pos += it->vel;
 
                 // Change direction if homing
@@ -2056,10 +3193,17 @@ int main(int, char**)
                 }
 
                 // Hit terrain
+                if (auto hit = w.map->SegmentCast(old_pos, it->pos, 2); hit.hit) // This catches fast bullets that would otherwise pass through thin walls.
+                {
+                    it->pos = hit.pos;
+                    it->DeathEffect(w);
+                    w.bullet_list.RemoveAt(index);
+                    continue;
+                }
                 if (w.Solid(iround(it->pos), bullet_hitbox))
                 {
                     it->DeathEffect(w);
-                    it = w.bullet_list.erase(it);
+                    w.bullet_list.RemoveAt(index);
                     continue;
                 }
 
@@ -2067,7 +3211,7 @@ int main(int, char**)
                 if (!w.p.dead && it->Enemy() && (it->pos - w.p.Center()).len() < plr_hitbox_rad + it->CollisionRadius())
                 {
                     it->DeathEffect(w);
-                    it = w.bullet_list.erase(it);
+                    w.bullet_list.RemoveAt(index);
                     KillPlayer();
                     continue;
                 }
@@ -2077,82 +3221,87 @@ int main(int, char**)
                 {
                     bool hit = 0;
 
+                    // Find the first crystal and the first orb that were hit.
+                    constexpr std::size_t none = -1;
+                    std::size_t crystal_index = none, orb_index = none;
+                    enemy_grid.Query(it->pos, enemy_hit_dist, [&](std::size_t i)
+                    {
+                        std::size_t crystal_count = boss.crystal_list.size();
+                        if (i < crystal_count)
+                        {
+                            if (i < crystal_index && (boss.crystal_list[i].pos - it->pos).len() < enemy_hit_dist)
+                                crystal_index = i;
+                        }
+                        else
+                        {
+                            if (i - crystal_count < orb_index && (boss.magic_orb_list[i - crystal_count].pos - it->pos).len() < enemy_hit_dist)
+                                orb_index = i - crystal_count;
+                        }
+                    });
+
                     { // Crystals
-                        auto enemy = boss.crystal_list.begin();
-                        while (enemy != boss.crystal_list.end())
+                        if (crystal_index != none)
                         {
-                            if ((enemy->pos - it->pos).len() < 14)
+                            auto enemy = boss.crystal_list.begin() + crystal_index;
+                            hit = 1;
+                            boss.crystals_wait = 0;
+                            w.enable_light = 1;
+
+                            if (enemy->invin == 0)
                             {
-                                hit = 1;
-                                boss.crystals_wait = 0;
-                                w.enable_light = 1;
+                                enemy->invin = enemy_invin_frames;
+                                enemy->hp--;
 
-                                if (enemy->invin == 0)
+                                if (enemy->hp > 0)
                                 {
-                                    enemy->invin = enemy_invin_frames;
-                                    enemy->hp--;
-
-                                    if (enemy->hp > 0)
-                                    {
-                                        Sounds::boss_hit(enemy->pos);
-                                    }
-                                    else
+                                    Sounds::boss_hit(enemy->pos);
+                                }
+                                else
+                                {
+                                    Sounds::boss_big_hit(enemy->pos);
+                                    for (int i = 0; i < 16; i++)
                                     {
-                                        Sounds::boss_big_hit(enemy->pos);
-                                        for (int i = 0; i < 16; i++)
-                                        {
-                                            fvec3 c(1, random_real_range(0.2,1), 0);
-                                            w.AddParticle(c, 1, 0.5, enemy->pos + fvec2(random_real_range(1), random_real_range(1)), random_real_range(f_pi), random_real_range(0.2),
-                                                          random_real_range(1,3), random_real_range(18,24), random_int_range(10,35));
-                                        }
-                                        boss.crystal_list.erase(enemy);
+                                        fvec3 c(1, random_real_range(0.2,1), 0);
+                                        w.AddParticle(c, 1, 0.5, enemy->pos + fvec2(random_real_range(1), random_real_range(1)), random_real_range(f_pi), random_real_range(0.2),
+                                                      random_real_range(1,3), random_real_range(18,24), random_int_range(10,35));
                                     }
+                                    boss.crystal_list.erase(enemy);
+                                    BuildEnemyGrid();
                                 }
-
-                                break;
                             }
-                            enemy++;
                         }
                     }
 
                     // Orbs
-                    if (!hit)
+                    if (!hit && orb_index != none)
                     {
-                        auto enemy = boss.magic_orb_list.begin();
-                        while (enemy != boss.magic_orb_list.end())
+                        auto enemy = boss.magic_orb_list.begin() + orb_index;
+                        hit = 1;
+
+                        if (enemy->invin == 0)
                         {
-                            if ((enemy->pos - it->pos).len() < 14)
+                            enemy->invin = enemy_invin_frames;
+                            enemy->hp--;
+
+                            if (enemy->hp > 0)
+                            {
+                                Sounds::boss_hit(enemy->pos, 4);
+                            }
+                            else
                             {
-                                hit = 1;
+                                if (boss.magic_orb_list.size() > 1) // The condition is here because otherwise this sound would interfere with some boss sound.
+                                    Sounds::boss_big_hit(enemy->pos);
 
-                                if (enemy->invin == 0)
+                                for (int i = 0; i < 16; i++)
                                 {
-                                    enemy->invin = enemy_invin_frames;
-                                    enemy->hp--;
-
-                                    if (enemy->hp > 0)
-                                    {
-                                        Sounds::boss_hit(enemy->pos, 4);
-                                    }
-                                    else
-                                    {
-                                        if (boss.magic_orb_list.size() > 1) // The condition is here because otherwise this sound would interfere with some boss sound.
-                                            Sounds::boss_big_hit(enemy->pos);
-
-                                        for (int i = 0; i < 16; i++)
-                                        {
-                                            float c = random_real_range(0,1);
-                                            fvec3 color(1, 0.6+c*0.4, 0.2+c*0.8);
-                                            w.AddParticle(color, 1, 0.5, enemy->pos + fvec2(random_real_range(1), random_real_range(1)), random_real_range(f_pi), random_real_range(0.2),
-                                                          random_real_range(1,3), random_real_range(18,24), random_int_range(10,35));
-                                        }
-                                        boss.magic_orb_list.erase(enemy);
-                                    }
+                                    float c = random_real_range(0,1);
+                                    fvec3 color(1, 0.6+c*0.4, 0.2+c*0.8);
+                                    w.AddParticle(color, 1, 0.5, enemy->pos + fvec2(random_real_range(1), random_real_range(1)), random_real_range(f_pi), random_real_range(0.2),
+                                                  random_real_range(1,3), random_real_range(18,24), random_int_range(10,35));
                                 }
-
-                                break;
+                                boss.magic_orb_list.erase(enemy);
+                                BuildEnemyGrid();
                             }
-                            enemy++;
                         }
                     }
 
@@ -2173,13 +3322,13 @@ int main(int, char**)
                     if (hit)
                     {
                         it->DeathEffect(w);
-                        it = w.bullet_list.erase(it);
+                        w.bullet_list.RemoveAt(index);
                         continue;
                     }
                 }
-
-                it++;
             }
+
+            w.bullet_list.Compact();
         }
 
         { // Camera
@@ -2193,36 +3342,9 @@ int main(int, char**)
             w.cam_pos_i = iround(w.cam_pos);
         }
 
-        { // Light particles
-            auto it = w.light_list.begin();
-            while (it != w.light_list.end())
-            {
-                it->cur_life++;
-                if (it->cur_life > it->life)
-                {
-                    it = w.light_list.erase(it);
-                    continue;
-                }
-                it->pos += fvec2::dir(it->dir, it->speed);
-                it->dir += it->av;
-                it++;
-            }
-        }
-
-        { // Normal particles
-            auto it = w.particle_list.begin();
-            while (it != w.particle_list.end())
-            {
-                it->cur_life++;
-                if (it->cur_life > it->life)
-                {
-                    it = w.particle_list.erase(it);
-                    continue;
-                }
-                it->pos += fvec2::dir(it->dir, it->speed);
-                it->dir += it->av;
-                it++;
-            }
+        { // Particles
+            w.light_list.Tick();
+            w.particle_list.Tick();
         }
 
         { // Clouds
@@ -2247,7 +3369,7 @@ int main(int, char**)
         }
 
         { // Respawn
-            if (w.p.dead && w.p.death_timer > 20 && Interface::Button().AssignKey())
+            if (w.p.dead && w.p.death_timer > 20 && ctl.pressed(Controls::any_key))
                 w.p.respawning = 1;
         }
 
@@ -2293,16 +3415,72 @@ int main(int, char**)
                 {
                     w.b.hits_taken = 3;
                 }
+
+                // Rewind
+                if (Interface::Button(Interface::Inputs::f3).pressed() && !snapshots.Empty())
+                {
+                    snapshots.Newest().Restore(w);
+                    snapshots.PopNewest();
+                }
+                else if (metronome.ticks % snapshot_period == 0)
+                {
+                    snapshots.Push().Take(w);
+                }
             }
         }
     };
 
+    #ifdef HEADLESS
+    (void)death_messages;
+    (void)crystal_anim_offset;
+    (void)crystal_anim_period;
+
+    if (replay_file.size())
+        tick_count = replay.ticks.size();
+
+    std::vector<uint64_t> tick_times(tick_count);
+
+    uint64_t start_time = Clock::Time();
+    for (uint64_t i = 0; i < tick_count; i++)
+    {
+        metronome.ticks++;
+        Controls ctl = replay_file.size() ? replay.ticks[i] : Controls::Autopilot(w, metronome.ticks);
+        if (record_file.size())
+            recording.ticks.push_back(ctl);
+
+        uint64_t tick_start = Clock::Time();
+        Tick(ctl);
+        tick_times[i] = Clock::Time() - tick_start;
+    }
+    double seconds = Clock::TicksToSeconds(Clock::Time() - start_time);
+
+    if (record_file.size())
+        recording.Save(record_file);
+
+    std::cout << tick_count << " ticks in " << seconds << " s, " << std::fixed << std::setprecision(1) << tick_count / seconds << " ticks/s\n";
+    if (tick_count > 0)
+    {
+        auto Micros = [](uint64_t time) {return Clock::TicksToSeconds(time) * 1000000;};
+        uint64_t total = std::accumulate(tick_times.begin(), tick_times.end(), uint64_t(0));
+        std::sort(tick_times.begin(), tick_times.end());
+        std::cout << "Per tick: mean " << std::setprecision(2) << Micros(total) / tick_count << " us, p99 " << Micros(tick_times[(tick_count - 1) * 99 / 100])
+                  << " us, max " << Micros(tick_times.back()) << " us\n";
+    }
+    std::cout << "Seed " << recording.seed << ", checksum " << std::hex << std::setw(8) << std::setfill('0') << Replay::Checksum(w) << std::dec << '\n';
+    #else
+    // Rendering interpolates between the previous and the current tick, so the motion stays smooth when the frame rate is higher than the tick rate.
+    // Those are updated before each frame.
+    float frame_time = 0; // Fraction of a tick since the last one.
+    fvec2 cam_pos = fvec2(0);
+    ivec2 cam_pos_i = ivec2(0);
+
     auto Render = [&]
     {
         auto &boss = w.b;
+        fvec2 plr_pos = InterpolatePos(w.p.prev_pos, w.p.pos, frame_time), boss_pos = InterpolatePos(boss.prev_pos, boss.pos, frame_time);
 
         { // Map
-            w.map.Render(w.cam_pos_i);
+            w.map->Render(cam_pos_i);
         }
 
         { // Player
@@ -2310,15 +3488,15 @@ int main(int, char**)
 
             constexpr ivec2 size(32);
             // Alive
-            Quad(iround(w.p.pos - size/2).sub_y(8) - w.cam_pos_i, size, Src4(ivec2(0,128).add_x(size.x * (w.p.anim_state * 4 + w.p.anim_frame)), size, alpha));
+            Quad(iround(plr_pos - size/2).sub_y(8) - cam_pos_i, size, Src4(ivec2(0,128).add_x(size.x * (w.p.anim_state * 4 + w.p.anim_frame)), size, alpha));
 
             // Dead
             if (w.p.dead)
-                Quad(iround(w.p.pos - size/2).sub_y(8) - w.cam_pos_i, size, Src4(ivec2(0,128+32), size, 1-alpha));
+                Quad(iround(plr_pos - size/2).sub_y(8) - cam_pos_i, size, Src4(ivec2(0,128+32), size, 1-alpha));
 
             // Dash glow
             if (w.p.dash_len)
-                Quad(ivec2(w.p.Center() - size/2) - w.cam_pos_i, size, Src4(ivec2(96,96), size, 1, 0.5));
+                Quad(ivec2(w.p.Center() - w.p.pos + plr_pos - size/2) - cam_pos_i, size, Src4(ivec2(96,96), size, 1, 0.5));
         }
 
         { // Boss
@@ -2327,13 +3505,13 @@ int main(int, char**)
             {
                 constexpr ivec2 size(64);
                 // Shadow
-                Quad(it.pos - size/2 - w.cam_pos_i, size, Src4(ivec2(160,0), size));
+                Quad(it.pos - size/2 - cam_pos_i, size, Src4(ivec2(160,0), size));
                 // Body
                 ivec2 body_pos = it.pos.add_y(iround(sin(metronome.ticks % crystal_anim_period / float(crystal_anim_period) * 2 * f_pi) * crystal_anim_offset));
-                Quad(body_pos - size/2 - w.cam_pos_i, size, Src4(ivec2(96,0), size));
+                Quad(body_pos - size/2 - cam_pos_i, size, Src4(ivec2(96,0), size));
                 // Effect
                 float sz = random_real_range(1,1.06);
-                Quad(body_pos - size/2 - w.cam_pos_i + iround(fvec2(random_real_range(1.4), random_real_range(1.4))) - size*(sz-1)/2, size*sz, Src4(ivec2(96,0)+2, size-4, 0.5, 0.2));
+                Quad(body_pos - size/2 - cam_pos_i + iround(fvec2(random_real_range(1.4), random_real_range(1.4))) - size*(sz-1)/2, size*sz, Src4(ivec2(96,0)+2, size-4, 0.5, 0.2));
             }
 
             { // Safe shield
@@ -2341,7 +3519,7 @@ int main(int, char**)
                 {
                     constexpr ivec2 size(96);
                     float s = random_real_range(0.95,1.05);
-                    Quad(iround(boss.pos) - size/2*s - w.cam_pos_i, size*s, Src4(ivec2(0,288)+1, size-2, 0.9, 0.2));
+                    Quad(iround(boss_pos) - size/2*s - cam_pos_i, size*s, Src4(ivec2(0,288)+1, size-2, 0.9, 0.2));
                 }
             }
 
@@ -2353,12 +3531,12 @@ int main(int, char**)
                     if (!boss.magic_shield_broken)
                     {
                         float s = random_real_range(0.98,1.03);
-                        Quad(iround(boss.pos) - size/2*s - w.cam_pos_i, size*s, Src4(ivec2(96,288)+1, size-2, 0.9, 0.2));
+                        Quad(iround(boss_pos) - size/2*s - cam_pos_i, size*s, Src4(ivec2(96,288)+1, size-2, 0.9, 0.2));
                     }
 
                     constexpr int period = 300;
                     fvec2 d = fvec2::dir(f_pi*4*sin(int(metronome.ticks % period) / float(period) * f_pi * 2), size.x/2);
-                    Quad(iround(boss.pos) - d - d.rot90() - w.cam_pos_i, d*2, d.rot90()*2, Src4(ivec2(194,288)+2, size-4, 0.9, 0.2));
+                    Quad(iround(boss_pos) - d - d.rot90() - cam_pos_i, d*2, d.rot90()*2, Src4(ivec2(194,288)+2, size-4, 0.9, 0.2));
                 }
             }
 
@@ -2367,7 +3545,7 @@ int main(int, char**)
                 {
                     constexpr ivec2 size(32-2);
                     float s = random_real_range(0.94,1.06);
-                    Quad(iround(it.pos) - size/2*s - w.cam_pos_i, size*s, Src4(ivec2(160+1,96+1), size, 0.9, 0.2));
+                    Quad(iround(InterpolatePos(it.prev_pos, it.pos, frame_time)) - size/2*s - cam_pos_i, size*s, Src4(ivec2(160+1,96+1), size, 0.9, 0.2));
                 }
             }
 
@@ -2376,7 +3554,7 @@ int main(int, char**)
                 {
                     constexpr ivec2 size(96);
                     float s = random_real_range(0.98,1.03);
-                    Quad(iround(boss.mgc_target) - size/2*s - w.cam_pos_i, size*s, Src4(ivec2(0,384)+1, size-2, 0.9, 0.2));
+                    Quad(iround(boss.mgc_target) - size/2*s - cam_pos_i, size*s, Src4(ivec2(0,384)+1, size-2, 0.9, 0.2));
                 }
             }
 
@@ -2394,7 +3572,7 @@ int main(int, char**)
                     fvec4 color = (deadly ? fvec4(1,0.5,0.2,1) : fvec4(1,0.5,0.5,1));
                     for (int i = 0; i < (deadly ? 3 : 1); i++)
                     {
-                        Quad(boss.pos + dir * boss_laser_offset - n * width/2 - w.cam_pos, dir * (len - boss_laser_offset), n * width, Src4(color, deadly ? 0 : 0.5));
+                        Quad(boss_pos + dir * boss_laser_offset - n * width/2 - cam_pos, dir * (len - boss_laser_offset), n * width, Src4(color, deadly ? 0 : 0.5));
                         width -= 2;
                     }
                 }
@@ -2408,25 +3586,26 @@ int main(int, char**)
                     alpha = max(0, 1 - boss.death_timer / 60.);
 
                 // Shadow
-                Quad(iround(boss.pos).add_y(10) - size/2 - w.cam_pos_i, size, Src4(ivec2(160,0), size, alpha));
+                Quad(iround(boss_pos).add_y(10) - size/2 - cam_pos_i, size, Src4(ivec2(160,0), size, alpha));
 
                 // Body
-                Quad(iround(boss.pos).add_y(iround(sin(float(metronome.ticks % period) / period * f_pi * 2)*2)) - size/2 - w.cam_pos_i, size, Src4(ivec2(0,224), size, alpha));
+                Quad(iround(boss_pos).add_y(iround(sin(float(metronome.ticks % period) / period * f_pi * 2)*2)) - size/2 - cam_pos_i, size, Src4(ivec2(0,224), size, alpha));
             }
         }
 
         { // Bullets
             for (const auto &bullet : w.bullet_list)
-                bullet.Render(w.cam_pos_i);
+                bullet.Render(cam_pos_i, frame_time);
         }
 
         { // Particles
-            for (const auto &it : w.particle_list)
+            const auto &list = w.particle_list;
+            for (std::size_t i = 0; i < list.Count(); i++)
             {
                 constexpr int size = 64, m = 4;
-                float s = (1 - it.cur_life / float(it.life));
-                float sz = s * it.size;
-                Quad(it.pos - w.cam_pos - sz/2, fvec2(sz), Src4(0, it.color, ivec2(224,0)+m, ivec2(size-m*2), it.alpha, it.beta));
+                float s = (1 - list.cur_life[i] / float(list.life[i]));
+                float sz = s * list.size[i];
+                Quad(InterpolatePos(list.prev_pos[i], list.pos[i], frame_time) - cam_pos - sz/2, fvec2(sz), Src4(0, list.color[i], ivec2(224,0)+m, ivec2(size-m*2), list.alpha[i], list.beta[i]));
             }
         }
 
@@ -2436,7 +3615,7 @@ int main(int, char**)
                 constexpr ivec2 size(32);
                 float alpha = clamp((1-w.dark_force_timer) * 2);
                 for (int i = 0; i < 2; i++)
-                    Quad(w.dark_force_pos[i] - size/2 - w.cam_pos_i, size, Src4(ivec2(128,96), size, alpha, 1));
+                    Quad(w.dark_force_pos[i] - size/2 - cam_pos_i, size, Src4(ivec2(128,96), size, alpha, 1));
             }
         }
 
@@ -2470,16 +3649,16 @@ int main(int, char**)
                     if (offset == ivec2(0))
                         color = fvec3(0);
 
-                    Text<0>(w.BossHome().sub_y(96-24*0) + offset - w.cam_pos_i, "This is it", color, clamp(boss.death_timer/60. - 5));
-                    Text<0>(w.BossHome().sub_y(96-24*1) + offset - w.cam_pos_i, "Your mission is over", color, clamp(boss.death_timer/60. - 7));
-                    Text<0>(w.BossHome().sub_y(96-24*6) + offset - w.cam_pos_i, "Thanks for playing my game!", color, clamp(boss.death_timer/60. - 12));
-                    Text<0>(w.BossHome().sub_y(96-24*7) + offset - w.cam_pos_i, Str("You died ", death_counter, death_counter == 1 ? " time" : " times"), color, clamp(boss.death_timer/60. - 14));
+                    Text<0>(w.BossHome().sub_y(96-24*0) + offset - cam_pos_i, "This is it", color, clamp(boss.death_timer/60. - 5));
+                    Text<0>(w.BossHome().sub_y(96-24*1) + offset - cam_pos_i, "Your mission is over", color, clamp(boss.death_timer/60. - 7));
+                    Text<0>(w.BossHome().sub_y(96-24*6) + offset - cam_pos_i, "Thanks for playing my game!", color, clamp(boss.death_timer/60. - 12));
+                    Text<0>(w.BossHome().sub_y(96-24*7) + offset - cam_pos_i, Str("You died ", death_counter, death_counter == 1 ? " time" : " times"), color, clamp(boss.death_timer/60. - 14));
                 }
             }
         }
 
         { // Tutorial GUI
-            ivec2 spawn = w.map.SpawnTile() * tile_size + tile_size/2;
+            ivec2 spawn = w.map->SpawnTile() * tile_size + tile_size/2;
 
             auto Message = [&](bool revisitable, int y, int off, std::string text)
             {
@@ -2492,7 +3671,7 @@ int main(int, char**)
                     if (offset == ivec2(0))
                         color = fvec3(0);
 
-                    Text<0>(spawn.sub_y(y + off) + offset - w.cam_pos_i, text, color, alpha);
+                    Text<0>(spawn.sub_y(y + off) + offset - cam_pos_i, text, color, alpha);
                 }
             };
 
@@ -2532,7 +3711,7 @@ int main(int, char**)
 
     auto Background = [&]
     {
-        ivec2 v = iround(w.cloud_offset - w.cam_pos / 2);
+        ivec2 v = iround(w.cloud_offset - cam_pos / 2);
         Draw::Background(0, iround(v / 10.));
         Draw::Background(1, iround(v / 4.));
         Draw::Background(2, iround(v / 2.));
@@ -2542,11 +3721,12 @@ int main(int, char**)
     {
         // Bullets
         for (const auto &bullet : w.bullet_list)
-            Draw::Light(bullet.pos - w.cam_pos, bullet.LightSize(), bullet.LightColor());
+            Draw::Light(InterpolatePos(bullet.prev_pos, bullet.pos, frame_time) - cam_pos, bullet.LightSize(), bullet.LightColor());
 
         // Light particles
-        for (const auto &li : w.light_list)
-            Draw::Light(li.pos - w.cam_pos, li.size * (1 - li.cur_life / float(li.life)), li.color);
+        const auto &lights = w.light_list;
+        for (std::size_t i = 0; i < lights.Count(); i++)
+            Draw::Light(InterpolatePos(lights.prev_pos[i], lights.pos[i], frame_time) - cam_pos, lights.size[i] * (1 - lights.cur_life[i] / float(lights.life[i])), lights.color[i]);
     };
 
     Sounds::Init();
@@ -2555,6 +3735,8 @@ int main(int, char**)
 
     uint64_t frame_start = Clock::Time();
 
+    Rand::generator_t render_generator; // Rendering gets its own generator, so that the frame rate doesn't affect the game state.
+
     while (1)
     {
         uint64_t time = Clock::Time(), frame_delta = time - frame_start;
@@ -2567,23 +3749,35 @@ int main(int, char**)
             if (win.Resized())
                 Draw::Resize();
             if (win.ExitRequested())
+            {
+                if (record_file.size())
+                    recording.Save(record_file);
                 Program::Exit();
+            }
 
-            Tick();
+            Controls ctl = metronome.ticks <= replay.ticks.size() ? replay.ticks[metronome.ticks-1] : Controls::FromWindow(w); // After a replay ends, the player takes over.
+            if (record_file.size())
+                recording.ticks.push_back(ctl);
+            Tick(ctl);
 
             audio.CheckErrors();
             Audio::Source::RemoveUnused();
         }
 
+        Rand::GeneratorOverride render_generator_override(render_generator);
+
+        frame_time = metronome.Time();
+        cam_pos = InterpolatePos(w.prev_cam_pos, w.cam_pos, frame_time);
+        cam_pos_i = iround(cam_pos);
+
         // Render in original scale
         // - Background
         Draw::fbuf_scale_bg.Bind();
         Graphics::Viewport(screen_sz);
-        Draw::ShaderMain::shader.Bind();
 
         Graphics::Clear();
         Background();
-        Draw::Queue::Flush();
+        Draw::Flush();
 
         // - Everything else
         Draw::fbuf_scale.Bind();
@@ -2592,7 +3786,7 @@ int main(int, char**)
         Graphics::Clear();
         Graphics::SetClearColor(fvec3(0));
         Render();
-        Draw::Queue::Flush();
+        Draw::Flush();
 
         // Render light
         Draw::fbuf_light.Bind();
@@ -2641,6 +3835,7 @@ int main(int, char**)
 
         win.SwapBuffers();
     }
+    #endif
 
     return 0;
 }
@@ -9,13 +9,18 @@
 #include "utils/archive.h"
 #include "utils/audio.h"
 #include "utils/clock.h"
+#include "utils/copy_on_write.h"
 #include "utils/dynamic_storage.h"
+#include "utils/fast_trig.h"
 #include "utils/finally.h"
 #include "utils/macro.h"
 #include "utils/mat.h"
 #include "utils/memory_file.h"
 #include "utils/meta.h"
 #include "utils/metronome.h"
+#include "utils/pool.h"
 #include "utils/random.h"
 #include "utils/resource_allocator.h"
+#include "utils/ring_buffer.h"
 #include "utils/strings.h"
+#include "utils/uniform_grid.h"
@@ -22,6 +22,12 @@ namespace Refl::Custom
 
         using element_type = typename T::value_type;
 
+        template <typename A> using _has_data_impl = decltype(std::declval<A &>().data(), std::declval<A &>().resize(std::size_t{}));
+        inline static constexpr bool is_contiguous = Meta::is_detected<_has_data_impl, T>;
+
+        static constexpr auto data(T &object) {return object.data();}
+        static constexpr void resize(T &object, std::size_t size) {object.resize(size);}
+
         template <typename A> using _has_single_arg_insert_impl = decltype(std::declval<A &>().insert(std::declval<element_type &>()));
         inline static constexpr bool _has_single_arg_insert = Meta::is_detected<_has_single_arg_insert_impl, T>;
 
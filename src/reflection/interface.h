@@ -3,11 +3,14 @@
 
 #include <array>
 #include <cstddef>
-#include <map>
+#include <cstdint>
+#include <cstring>
 #include <string>
+#include <string_view>
 #include <tuple>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "program/errors.h"
 #include "utils/meta.h"
@@ -29,11 +32,16 @@ namespace Refl
             using not_specialized_tag = void; // Don't forget to remove this when specializing.
 
             inline static const std::string name = "??";
-            static std::string to_string(const T &) {return "??";}
+            static void to_string(const T &, std::string &out) {out += "??";} // Appends to the string.
 
             // On success, returns 1, changes the referenced object, and advances the char pointer.
             // On failure, returns 0. Values of the object and the char pointer are unspecfified.
             static bool from_string(T &, const char *&) {return 0;}
+
+            // Appends the binary representation to the vector.
+            static void to_binary(const T &, std::vector<uint8_t> &) {}
+            // Same as `from_string()`, but `end` points to the end of the data.
+            static bool from_binary(T &, const uint8_t *&, const uint8_t *) {return 0;}
         };
 
         template <typename T, typename = void> struct Structure
@@ -44,7 +52,7 @@ namespace Refl
             inline static const std::string name = "??";
             static constexpr int field_count = 0;
             template <int I> static constexpr void field(T &); // When specialized, should return `auto &`.
-            static std::string field_name(int index) {(void)index; return "??";}
+            static constexpr std::string_view field_name(int index) {(void)index; return "??";}
             static constexpr FieldCategory field_category(int index) {(void)index; return FieldCategory::default_category;}
         };
 
@@ -65,6 +73,12 @@ namespace Refl
             using element_type = int;
             static constexpr void insert(T &, const element_type &) {}
             static constexpr void insert_move(T &, element_type &&) {}
+
+            // If this is true, the elements are stored contiguously, and can be accessed with `data()`.
+            // Then arithmetic elements are copied in bulk by the binary serialization.
+            static constexpr bool is_contiguous = 0;
+            static constexpr void data(T &) {} // Should return a pointer to the first element.
+            static constexpr void resize(T &, std::size_t) {}
         };
     }
 
@@ -89,13 +103,108 @@ namespace Refl
         };
 
 
+        [[noreturn]] inline void binary_data_ended()
+        {
+            Program::Error("Unexpected end of data.");
+        }
+
+        inline void binary_read(const uint8_t *&ptr, const uint8_t *end, void *target, std::size_t size)
+        {
+            if (std::size_t(end - ptr) < size)
+                binary_data_ended();
+            if (size > 0) // `target` can be null then.
+                std::memcpy(target, ptr, size);
+            ptr += size;
+        }
+        inline void binary_write(std::vector<uint8_t> &out, const void *source, std::size_t size)
+        {
+            out.insert(out.end(), (const uint8_t *)source, (const uint8_t *)source + size);
+        }
+
+        // A perfect hash table of field names, built at compile time, to look up fields by name without comparing with every name.
+        template <int N> class FieldNameTable
+        {
+            static constexpr int size = []
+            {
+                int ret = 1;
+                while (ret < N * 4) // With this load factor, a seed without collisions is found after a few attempts.
+                    ret *= 2;
+                return ret;
+            }();
+
+            std::array<std::string_view, N> names{};
+            std::array<int, size> indices{}; // -1 for empty slots.
+            uint32_t seed = 0;
+
+            [[nodiscard]] static constexpr int Slot(std::string_view name, uint32_t seed) // FNV-1a.
+            {
+                uint32_t ret = 2166136261u ^ seed;
+                for (char ch : name)
+                    ret = (ret ^ uint8_t(ch)) * 16777619u;
+                return (ret ^ ret >> 16) & (size - 1);
+            }
+
+          public:
+            constexpr FieldNameTable(std::array<std::string_view, N> names) : names(names)
+            {
+                for (int i = 0; i < N; i++)
+                for (int j = 0; j < i; j++)
+                {
+                    if (names[i] == names[j])
+                        throw "Duplicate field names."; // Causes a compilation error.
+                }
+
+                while (1)
+                {
+                    for (int &index : indices)
+                        index = -1;
+
+                    bool ok = 1;
+                    for (int i = 0; i < N && ok; i++)
+                    {
+                        int &index = indices[Slot(names[i], seed)];
+                        if (index != -1)
+                            ok = 0;
+                        index = i;
+                    }
+                    if (ok)
+                        break;
+                    seed++;
+                }
+            }
+
+            [[nodiscard]] constexpr int find(std::string_view name) const // Returns -1 if there is no such name.
+            {
+                if constexpr (N == 0)
+                {
+                    (void)name;
+                    return -1;
+                }
+                else
+                {
+                    int index = indices[Slot(name, seed)];
+                    return index != -1 && names[index] == name ? index : -1;
+                }
+            }
+        };
+
+        // `T` is a specialization of `Custom::Structure`.
+        template <typename T> inline constexpr FieldNameTable<T::field_count> field_name_table = []<int ...I>(std::integer_sequence<int, I...>)
+        {
+            return FieldNameTable<T::field_count>({T::field_name(I)...});
+        }
+        (std::make_integer_sequence<int, T::field_count>{});
+
         constexpr bool is_alphanum(char ch)
         {
             return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') || ch == '_';
         }
 
-        void skip_whitespace(const char *&ptr) // Also skips comments (from '#' to '\n' or `\r`).
+        inline void skip_whitespace(const char *&ptr) // Also skips comments (from '#' to '\n' or `\r`).
         {
+            if (*ptr > ' ' && *ptr != '#') // Most of the time there is nothing to skip.
+                return;
+
             while (1)
             {
                 while (*ptr > '\0' && *ptr <= ' ')
@@ -177,48 +286,50 @@ namespace Refl
         }
 
         // Universal
-        std::string to_string() const
+        void to_string_low(std::string &out) const // Appends to the string. The string can be reused to avoid reallocations.
         {
             if constexpr (is_primitive)
             {
-                return low::to_string(*ptr);
+                low::to_string(*ptr, out);
             }
             else if constexpr (is_structure)
             {
-                std::string ret;
-                ret += '{';
+                out += '{';
                 for_each_field([&, this](auto index)
                 {
                     constexpr int i = index.value;
 
                     if constexpr (i != 0)
-                        ret += ',';
+                        out += ',';
 
-                    ret += field_name(i);
-                    ret += '=';
-                    ret += field<i>().to_string();
+                    out += field_name(i);
+                    out += '=';
+                    field<i>().to_string_low(out);
                 });
-                ret += '}';
-                return ret;
+                out += '}';
             }
             else // is_container
             {
-                std::string ret;
-                ret += '[';
+                out += '[';
                 bool first = 1;
                 for_each_element([&](auto it)
                 {
                     if (first)
                         first = 0;
                     else
-                        ret += ',';
+                        out += ',';
 
-                    ret += Refl::Interface(*it).to_string(); // We have to use `Refl::Interface` instead of `Interface` for template argument deduction to work.
+                    Refl::Interface(*it).to_string_low(out); // We have to use `Refl::Interface` instead of `Interface` for template argument deduction to work.
                 });
-                ret += ']';
-                return ret;
+                out += ']';
             }
         }
+        std::string to_string() const
+        {
+            std::string ret;
+            to_string_low(ret);
+            return ret;
+        }
 
         void from_string_low(const char *&str, FromStringMode mode)
         {
@@ -297,9 +408,10 @@ namespace Refl
                     }
 
                     // Read field name.
-                    std::string name;
+                    const char *name_begin = str;
                     while (impl::is_alphanum(*str))
-                        name += *str++;
+                        str++;
+                    std::string_view name(name_begin, str - name_begin);
 
                     // Stop if field name is empty.
                     if (name.empty()) Program::Error("Expected field name.");
@@ -327,7 +439,7 @@ namespace Refl
                     {
                         std::string msg = e.what();
                         std::string append;
-                        append = "." + name;
+                        append = "." + std::string(name);
                         if (msg[0] != '.')
                             append += ": ";
                         msg = append + msg;
@@ -345,23 +457,26 @@ namespace Refl
                 if (mode == full)
                 {
                     bool incomplete = 0;
-                    std::string missing;
                     for (int i = 0; i < field_count(); i++)
                     {
-                        if (field_category(i) == FieldCategory::optional)
-                            continue;
-                        if (!existing_fields[i])
-                        {
+                        if (field_category(i) != FieldCategory::optional && !existing_fields[i])
                             incomplete = 1;
+                    }
+                    if (incomplete)
+                    {
+                        std::string missing;
+                        for (int i = 0; i < field_count(); i++)
+                        {
+                            if (field_category(i) == FieldCategory::optional || existing_fields[i])
+                                continue;
                             if (missing.size() > 0)
                                 missing += ", ";
                             missing += '`';
                             missing += field_name(i);
                             missing += '`';
                         }
-                    }
-                    if (incomplete)
                         Program::Error("Following fields are missing: ", missing, ".");
+                    }
                 }
             }
             else // is_constainer
@@ -455,6 +570,180 @@ namespace Refl
             }
         }
 
+        // The binary format is the values of the primitives, in the native byte order, without any names or separators.
+        // Containers are prefixed with the element count, as `uint64_t`.
+        // `to_binary()` and `from_binary()` add the schema hash at the beginning, so that the data from a different version of the type is rejected.
+        static std::string schema() // A description of the type and its binary layout.
+        {
+            if constexpr (is_primitive)
+            {
+                return type_name() + ':' + std::to_string(sizeof(type_no_cvref));
+            }
+            else if constexpr (is_structure)
+            {
+                std::string ret = type_name() + '{';
+                for_each_field([&](auto index)
+                {
+                    constexpr int i = index.value;
+                    if constexpr (i != 0)
+                        ret += ',';
+                    ret += field_name(i);
+                    ret += '=';
+                    ret += Interface<field_type<i> &>::schema();
+                });
+                ret += '}';
+                return ret;
+            }
+            else // is_container
+            {
+                return '[' + Interface<mutable_element_type &>::schema() + ']';
+            }
+        }
+        static uint64_t schema_hash() // FNV-1a of `schema()`.
+        {
+            static const uint64_t ret = []
+            {
+                uint64_t hash = 14695981039346656037u;
+                for (char ch : schema())
+                    hash = (hash ^ uint8_t(ch)) * 1099511628211u;
+                return hash;
+            }();
+            return ret;
+        }
+
+        void to_binary_low(std::vector<uint8_t> &out) const
+        {
+            if constexpr (is_primitive)
+            {
+                low::to_binary(*ptr, out);
+            }
+            else if constexpr (is_structure)
+            {
+                for_each_field([&](auto index)
+                {
+                    field<index.value>().to_binary_low(out);
+                });
+            }
+            else // is_container
+            {
+                uint64_t size = low::size(*ptr);
+                impl::binary_write(out, &size, sizeof size);
+
+                if constexpr (bulk_binary)
+                {
+                    impl::binary_write(out, low::data(*ptr), size * sizeof(element_type));
+                }
+                else
+                {
+                    for_each_element([&](auto it)
+                    {
+                        Refl::Interface(*it).to_binary_low(out);
+                    });
+                }
+            }
+        }
+        [[nodiscard]] std::vector<uint8_t> to_binary() const
+        {
+            std::vector<uint8_t> ret;
+            uint64_t hash = schema_hash();
+            impl::binary_write(ret, &hash, sizeof hash);
+            to_binary_low(ret);
+            return ret;
+        }
+
+        void from_binary_low(const uint8_t *&data, const uint8_t *end)
+        {
+            static_assert(is_mutable);
+
+            if constexpr (is_primitive)
+            {
+                if (!low::from_binary(*ptr, data, end))
+                    Program::Error("Primitive type parsing failed.");
+            }
+            else if constexpr (is_structure)
+            {
+                for_each_field([&](auto index)
+                {
+                    constexpr int i = index.value;
+                    try
+                    {
+                        field<i>().from_binary_low(data, end);
+                    }
+                    catch (std::exception &e)
+                    {
+                        std::string msg = e.what();
+                        std::string append = "." + std::string(field_name(i));
+                        if (msg[0] != '.')
+                            append += ": ";
+                        Program::Error(append + msg);
+                    }
+                });
+            }
+            else // is_container
+            {
+                *ptr = {};
+
+                uint64_t size;
+                impl::binary_read(data, end, &size, sizeof size);
+
+                if constexpr (bulk_binary)
+                {
+                    if (uint64_t(end - data) / sizeof(element_type) < size)
+                        impl::binary_data_ended();
+                    low::resize(*ptr, size);
+                    impl::binary_read(data, end, low::data(*ptr), size * sizeof(element_type));
+                }
+                else
+                {
+                    for (uint64_t index = 0; index < size; index++)
+                    {
+                        try
+                        {
+                            mutable_element_type tmp{};
+                            Refl::Interface(tmp).from_binary_low(data, end);
+                            insert(std::move(tmp));
+                        }
+                        catch (std::exception &e)
+                        {
+                            std::string msg = e.what();
+                            std::string append = "." + std::to_string(index);
+                            if (msg[0] != '.')
+                                append += ": ";
+                            Program::Error(append + msg);
+                        }
+                    }
+                }
+            }
+        }
+        void from_binary(const uint8_t *begin, const uint8_t *end)
+        {
+            try
+            {
+                uint64_t hash;
+                impl::binary_read(begin, end, &hash, sizeof hash);
+                if (hash != schema_hash())
+                    Program::Error("Schema hash mismatch, the data was saved by a different version of the type.");
+                from_binary_low(begin, end);
+                if (begin != end)
+                    Program::Error("Unexpected data at the end.");
+            }
+            catch (std::exception &e)
+            {
+                std::string msg = e.what();
+                if (msg[0] == '.')
+                {
+                    msg.erase(msg.begin());
+                    msg = "At: " + msg;
+                }
+                msg = "Unable to read binary reflected object:\n" + msg;
+                Program::Error(msg);
+            }
+        }
+        void from_binary(const std::vector<uint8_t> &data)
+        {
+            from_binary(data.data(), data.data() + data.size());
+        }
+
         template <typename F> static constexpr void for_each_field(F &&func) // Func receives indices as `std::integral_constant<int,i>`.
         {
             static_assert(is_structure);
@@ -483,7 +772,7 @@ namespace Refl
             static_assert(is_structure);
             return Refl::Interface(field_value<I>()); // We have to use `Refl::Interface` instead of `Interface` for template argument deduction to work.
         }
-        static std::string field_name(int index)
+        static constexpr std::string_view field_name(int index)
         {
             static_assert(is_structure);
             if (index < 0 || index >= field_count())
@@ -497,30 +786,22 @@ namespace Refl
                 return FieldCategory::default_category;
             return low::field_category(index);
         }
-        static int field_index_from_name(std::string name) // Returns -1 if no such field.
+        static constexpr int field_index_from_name(std::string_view name) // Returns -1 if no such field.
         {
-            if constexpr (!is_lvalue || !is_mutable)
-            {
-                return Interface<type_no_cvref &>::field_index_from_name(name);
-            }
-            else
-            {
-                static const std::map<std::string, int> map = []<int ...I>(std::integer_sequence<int, I...>)
-                {
-                    return std::map<std::string, int>{{field_name(I), I}...};
-                }
-                (std::make_integer_sequence<int, field_count()>{});
-
-                if (auto it = map.find(name); it != map.end())
-                    return it->second;
-                else
-                    return -1;
-            }
+            static_assert(is_structure);
+            return impl::field_name_table<low>.find(name);
         }
 
         // Container-specific
         using element_type = typename decltype(element_type_helper())::type;
         using mutable_element_type = typename impl::make_mutable<std::remove_const_t<element_type>>::type;
+        static constexpr bool bulk_binary = []
+        {
+            if constexpr (!is_container)
+                return 0;
+            else
+                return low::is_contiguous && std::is_arithmetic_v<element_type> && !std::is_same_v<element_type, bool>;
+        }();
         constexpr auto begin() const
         {
             static_assert(is_container);
@@ -1,12 +1,13 @@
 #ifndef REFLECTION_PRIMITIVES_ARITHMETIC_H_INCLUDED
 #define REFLECTION_PRIMITIVES_ARITHMETIC_H_INCLUDED
 
-#include <cstdio>
+#include <charconv>
 #include <cstdlib>
 #include <cstring>
 #include <limits>
 #include <string>
 #include <type_traits>
+#include <vector>
 
 #include "interface.h"
 
@@ -35,32 +36,69 @@ namespace Refl::Custom
             return "??";
         }();
 
-        static std::string to_string(const T &object)
+        static void to_string(const T &object, std::string &out)
         {
             if constexpr (std::is_same_v<T, bool>)
             {
-                return object ? "true" : "false";
+                out += object ? "true" : "false";
             }
-            if constexpr (std::is_integral_v<T>)
+            else if constexpr (std::is_integral_v<T>)
             {
-                return std::to_string(object);
+                // Character types are printed as numbers, like `std::to_string()` does.
+                using use_type = std::conditional_t<(sizeof(T) < sizeof(int)), std::conditional_t<std::is_signed_v<T>, int, unsigned int>, T>;
+                char buffer[std::numeric_limits<use_type>::digits10 + 3];
+                out.append(buffer, std::to_chars(buffer, buffer + sizeof buffer, use_type(object)).ptr);
             }
             else
             {
+                // Same as `printf("%.*g")` with `max_digits10`, but faster and independent of the locale.
                 constexpr bool known_type = std::is_same_v<T, float> || std::is_same_v<T, double> || std::is_same_v<T, long double>;
                 using use_type = std::conditional_t<known_type, T, long double>;
-                constexpr const char *format = std::is_same_v<T, float>  ? "%.*g"  :
-                                               std::is_same_v<T, double> ? "%.*lg" :
-                                                /*long double or unknown*/ "%.*Lg";
                 constexpr int len = std::numeric_limits<use_type>::max_digits10;
-                char buffer[len*2];
-                std::snprintf(buffer, sizeof buffer, format, len, use_type(object));
-                return buffer;
+                char buffer[len + 16]; // Sign, point, exponent.
+                out.append(buffer, std::to_chars(buffer, buffer + sizeof buffer, use_type(object), std::chars_format::general, len).ptr);
+            }
+        }
+
+        // Tries to parse a plain decimal number with `std::from_chars`, which is much faster than `strto*` and doesn't depend on the locale.
+        // Returns 0 if the number has any unusual syntax (a leading `+`, a hex or octal prefix, `inf`, etc) or is out of range, then `strto*` has to be used instead.
+        static bool from_string_fast(T &object, const char *&string)
+        {
+            const char *end = string;
+            if (*end == '-')
+            {
+                if constexpr (std::is_unsigned_v<T>)
+                    return 0; // `strtoul` accepts this, and negates the result.
+                end++;
+            }
+
+            const char *digits = end;
+            while (*end >= '0' && *end <= '9')
+                end++;
+            if (end == digits || (*digits == '0' && end - digits > 1) || *end == 'x' || *end == 'X')
+                return 0;
+
+            if constexpr (std::is_floating_point_v<T>)
+            {
+                while ((*end >= '0' && *end <= '9') || *end == '.' || *end == 'e' || *end == 'E' || *end == '-' || *end == '+')
+                    end++;
             }
+
+            auto [ptr, error] = std::from_chars(string, end, object);
+            if (error != std::errc{})
+                return 0;
+            string = ptr;
+            return 1;
         }
 
         static bool from_string(T &object, const char *&string)
         {
+            if constexpr (!std::is_same_v<T, bool>)
+            {
+                if (from_string_fast(object, string))
+                    return 1;
+            }
+
             char *end;
 
             if constexpr (std::is_integral_v<T>)
@@ -116,6 +154,39 @@ namespace Refl::Custom
                 return 1;
             }
         }
+
+        static void to_binary(const T &object, std::vector<uint8_t> &out)
+        {
+            if constexpr (std::is_same_v<T, bool>)
+            {
+                out.push_back(object);
+            }
+            else
+            {
+                uint8_t bytes[sizeof(T)];
+                std::memcpy(bytes, &object, sizeof(T));
+                out.insert(out.end(), bytes, bytes + sizeof(T));
+            }
+        }
+
+        static bool from_binary(T &object, const uint8_t *&data, const uint8_t *end)
+        {
+            if constexpr (std::is_same_v<T, bool>)
+            {
+                if (data == end || *data > 1)
+                    return 0;
+                object = *data++;
+                return 1;
+            }
+            else
+            {
+                if (std::size_t(end - data) < sizeof(T))
+                    return 0;
+                std::memcpy(&object, data, sizeof(T));
+                data += sizeof(T);
+                return 1;
+            }
+        }
     };
 }
 
@@ -3,6 +3,7 @@
 
 #include <array>
 #include <string>
+#include <string_view>
 #include <tuple>
 #include <type_traits>
 
@@ -35,7 +36,7 @@
         /* Field access */\
         template <int I> static constexpr auto &field(_refl_this_type &ref) {return ref .* ::std::get<I>(_refl_member_pointers);} \
         /* Field names */\
-        static std::string field_name(int index) {return ::std::array{ MA_SEQ_FOR_EACH(REFL_Structure_FieldNamePack, MA_COMMA, , seq) }[index];} \
+        static constexpr ::std::string_view field_name(int index) {return ::std::array<::std::string_view, field_count>{ MA_SEQ_FOR_EACH(REFL_Structure_FieldNamePack, MA_COMMA, , seq) }[index];} \
         /* Field categories */\
         static constexpr ::Refl::FieldCategory field_category(int index) {return ::std::array{ MA_SEQ_FOR_EACH(REFL_Structure_FieldCategoryPack, MA_COMMA, , seq) }[index];} \
     }; \
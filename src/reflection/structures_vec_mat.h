@@ -3,6 +3,7 @@
 
 #include <array>
 #include <string>
+#include <string_view>
 
 #include "interface.h"
 
@@ -13,7 +14,7 @@ namespace Refl::Custom
     template <typename T> struct Structure<T, std::enable_if_t<Math::is_vector_v<T>>>
     {
         // Field indices are guaranteed to be in valid range.
-        inline static const std::string name = "vec" + std::to_string(T::size) + "<" + Refl::Interface<typename T::type>::name() + ">";
+        inline static const std::string name = "vec" + std::to_string(T::size) + "<" + Refl::Interface<typename T::type>::type_name() + ">";
 
         static constexpr int field_count = T::size;
         template <int I> static constexpr auto &field(T &object)
@@ -23,9 +24,9 @@ namespace Refl::Custom
             if constexpr (I == 2) return object.z;
             if constexpr (I == 3) return object.w;
         }
-        static std::string field_name(int index)
+        static constexpr std::string_view field_name(int index)
         {
-            return std::array<std::string,4>{"x","y","z","w"}[index];
+            return std::array<std::string_view,4>{"x","y","z","w"}[index];
         }
         static constexpr FieldCategory field_category(int index)
         {
@@ -1,5 +1,6 @@
 #include "archive.h"
 
+#include <limits>
 #include <type_traits>
 
 #include <zlib.h>
@@ -34,8 +35,8 @@ namespace Archive
     }
 
 
-    using size_type = uint32_t;
-    static_assert(std::is_unsigned_v<size_type> && sizeof(size_type) >= sizeof(std::size_t), "`size_type` must be an unsigned type not smaller than `std::size_t`.");
+    using size_type = uint32_t; // Larger sizes are rejected by `Compress()`.
+    static_assert(std::is_unsigned_v<size_type>, "`size_type` must be unsigned.");
 
     [[nodiscard]] std::size_t MaxCompressedSize(const uint8_t *src_begin, const uint8_t *src_end)
     {
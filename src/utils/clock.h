@@ -3,10 +3,27 @@
 
 #include <cstddef>
 
-#include <SDL2/SDL_timer.h>
+#ifdef HEADLESS
+#  include <chrono>
+#else
+#  include <SDL2/SDL_timer.h>
+#endif
 
 namespace Clock
 {
+    #ifdef HEADLESS
+    using clock_t = std::chrono::steady_clock; // Headless builds don't link SDL.
+
+    inline uint64_t Time()
+    {
+        return clock_t::now().time_since_epoch().count();
+    }
+
+    inline uint64_t TicksPerSecond()
+    {
+        return clock_t::period::den / clock_t::period::num;
+    }
+    #else
     inline uint64_t Time()
     {
         return SDL_GetPerformanceCounter();
@@ -17,6 +34,7 @@ namespace Clock
         static uint64_t ret = SDL_GetPerformanceFrequency();
         return ret;
     }
+    #endif
 
     inline uint64_t SecondsToTicks(double secs)
     {
@@ -0,0 +1,31 @@
+#ifndef UTILS_COPY_ON_WRITE_H_INCLUDED
+#define UTILS_COPY_ON_WRITE_H_INCLUDED
+
+#include <memory>
+#include <utility>
+
+/* Holds an object that is shared between copies, until one of them needs to modify it.
+ * Read access is through `*` and `->`, which are const. `Mut()` returns a modifiable reference, copying the object first if it's shared.
+ * Copies can be used from different threads, but `Mut()` must not be called on one of them while others are being copied.
+ */
+
+template <typename T> class CopyOnWrite
+{
+    std::shared_ptr<T> ptr;
+
+  public:
+    CopyOnWrite() : ptr(std::make_shared<T>()) {}
+    CopyOnWrite(T object) : ptr(std::make_shared<T>(std::move(object))) {}
+
+    [[nodiscard]] const T &operator*() const {return *ptr;}
+    [[nodiscard]] const T *operator->() const {return ptr.get();}
+
+    [[nodiscard]] T &Mut()
+    {
+        if (ptr.use_count() > 1)
+            ptr = std::make_shared<T>(*ptr);
+        return *ptr;
+    }
+};
+
+#endif
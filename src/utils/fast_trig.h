@@ -0,0 +1,194 @@
+#ifndef UTILS_FAST_TRIG_H_INCLUDED
+#define UTILS_FAST_TRIG_H_INCLUDED
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#if defined(__AVX2__)
+#  include <immintrin.h>
+#elif defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
+
+// Approximate sine and cosine, and batch kernels built on them.
+// The argument is reduced to `[-pi/4, pi/4]` and then polynomials from Cephes are used. The absolute error is about 1e-7 for `|x| < 1000`, and grows slowly after that.
+// The SIMD versions perform exactly the same operations as the scalar one, so they give the same results.
+// That requires the scalar code to use SSE too (`-mfpmath=sse`, the default on x86-64) rather than x87, and the compiler to not fuse multiplications and additions (no `-mfma`, or `-ffp-contract=off`).
+
+namespace FastTrig
+{
+    namespace impl
+    {
+        // `pi/2` split into three parts, so that `x - k * pi/2` loses less precision.
+        constexpr float half_pi_1 = 1.5703125f, half_pi_2 = 4.837512969970703125e-4f, half_pi_3 = 7.54978995489188216e-8f;
+        constexpr float two_over_pi = 0.636619772367581343f;
+
+        constexpr float sin_1 = -1.6666654611e-1f, sin_2 = 8.3321608736e-3f, sin_3 = -1.9515295891e-4f;
+        constexpr float cos_1 = 4.166664568298827e-2f, cos_2 = -1.388731625493765e-3f, cos_3 = 2.443315711809948e-5f;
+    }
+
+    inline void SinCos(float x, float &out_sin, float &out_cos)
+    {
+        using namespace impl;
+
+        float k = std::nearbyint(x * two_over_pi);
+        int quadrant = int(k);
+        float r = x - k * half_pi_1 - k * half_pi_2 - k * half_pi_3;
+        float r2 = r * r;
+
+        float s = ((sin_3 * r2 + sin_2) * r2 + sin_1) * r2 * r + r;
+        float c = ((cos_3 * r2 + cos_2) * r2 + cos_1) * r2 * r2 - 0.5f * r2 + 1;
+
+        if (quadrant & 1)
+            std::swap(s, c);
+        out_sin = (quadrant & 2) ? -s : s;
+        out_cos = ((quadrant + 1) & 2) ? -c : c;
+    }
+
+    #if defined(__SSE2__) && !defined(__AVX2__)
+    inline void SinCos(__m128 x, __m128 &out_sin, __m128 &out_cos)
+    {
+        using namespace impl;
+
+        __m128i quadrant = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(two_over_pi))); // Rounds to nearest, like `std::nearbyint()`.
+        __m128 k = _mm_cvtepi32_ps(quadrant);
+        __m128 r = _mm_sub_ps(x, _mm_mul_ps(k, _mm_set1_ps(half_pi_1)));
+        r = _mm_sub_ps(r, _mm_mul_ps(k, _mm_set1_ps(half_pi_2)));
+        r = _mm_sub_ps(r, _mm_mul_ps(k, _mm_set1_ps(half_pi_3)));
+        __m128 r2 = _mm_mul_ps(r, r);
+
+        __m128 s = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(sin_3), r2), _mm_set1_ps(sin_2));
+        s = _mm_add_ps(_mm_mul_ps(s, r2), _mm_set1_ps(sin_1));
+        s = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(s, r2), r), r);
+
+        __m128 c = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(cos_3), r2), _mm_set1_ps(cos_2));
+        c = _mm_add_ps(_mm_mul_ps(c, r2), _mm_set1_ps(cos_1));
+        c = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(_mm_mul_ps(c, r2), r2), _mm_mul_ps(_mm_set1_ps(0.5f), r2)), _mm_set1_ps(1));
+
+        __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+        __m128 new_s = _mm_or_ps(_mm_and_ps(swap, c), _mm_andnot_ps(swap, s));
+        __m128 new_c = _mm_or_ps(_mm_and_ps(swap, s), _mm_andnot_ps(swap, c));
+
+        // Bit 1 of the quadrant, moved to the sign bit.
+        __m128 sin_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(quadrant, _mm_set1_epi32(2)), 30));
+        __m128 cos_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(quadrant, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30));
+        out_sin = _mm_xor_ps(new_s, sin_sign);
+        out_cos = _mm_xor_ps(new_c, cos_sign);
+    }
+    #endif
+
+    #if defined(__AVX2__)
+    inline void SinCos(__m256 x, __m256 &out_sin, __m256 &out_cos)
+    {
+        using namespace impl;
+
+        __m256i quadrant = _mm256_cvtps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(two_over_pi))); // Rounds to nearest, like `std::nearbyint()`.
+        __m256 k = _mm256_cvtepi32_ps(quadrant);
+        __m256 r = _mm256_sub_ps(x, _mm256_mul_ps(k, _mm256_set1_ps(half_pi_1)));
+        r = _mm256_sub_ps(r, _mm256_mul_ps(k, _mm256_set1_ps(half_pi_2)));
+        r = _mm256_sub_ps(r, _mm256_mul_ps(k, _mm256_set1_ps(half_pi_3)));
+        __m256 r2 = _mm256_mul_ps(r, r);
+
+        __m256 s = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(sin_3), r2), _mm256_set1_ps(sin_2));
+        s = _mm256_add_ps(_mm256_mul_ps(s, r2), _mm256_set1_ps(sin_1));
+        s = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(s, r2), r), r);
+
+        __m256 c = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(cos_3), r2), _mm256_set1_ps(cos_2));
+        c = _mm256_add_ps(_mm256_mul_ps(c, r2), _mm256_set1_ps(cos_1));
+        c = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(_mm256_mul_ps(c, r2), r2), _mm256_mul_ps(_mm256_set1_ps(0.5f), r2)), _mm256_set1_ps(1));
+
+        __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(quadrant, _mm256_set1_epi32(1)), _mm256_set1_epi32(1)));
+        __m256 new_s = _mm256_blendv_ps(s, c, swap);
+        __m256 new_c = _mm256_blendv_ps(c, s, swap);
+
+        // Bit 1 of the quadrant, moved to the sign bit.
+        __m256 sin_sign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(quadrant, _mm256_set1_epi32(2)), 30));
+        __m256 cos_sign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(quadrant, _mm256_set1_epi32(1)), _mm256_set1_epi32(2)), 30));
+        out_sin = _mm256_xor_ps(new_s, sin_sign);
+        out_cos = _mm256_xor_ps(new_c, cos_sign);
+    }
+    #endif
+
+    // For each `i`: `pos[i] += fvec2::dir(dir[i], speed[i]); dir[i] += av[i];`, but with `SinCos()` instead of `std::sin` and `std::cos`.
+    // `pos` contains interleaved X and Y coordinates, so its size is `2 * count`.
+    inline void MoveAlongAngles(std::size_t count, float *pos, float *dir, const float *av, const float *speed)
+    {
+        std::size_t i = 0;
+
+        #if defined(__AVX2__)
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 d = _mm256_loadu_ps(dir + i);
+            __m256 s, c;
+            SinCos(d, s, c);
+            __m256 v = _mm256_loadu_ps(speed + i);
+            __m256 dx = _mm256_mul_ps(c, v), dy = _mm256_mul_ps(s, v);
+            __m256 lo = _mm256_unpacklo_ps(dx, dy), hi = _mm256_unpackhi_ps(dx, dy); // Points 0,1,4,5 and 2,3,6,7.
+            float *p = pos + i*2;
+            _mm256_storeu_ps(p, _mm256_add_ps(_mm256_loadu_ps(p), _mm256_permute2f128_ps(lo, hi, 0x20)));
+            _mm256_storeu_ps(p + 8, _mm256_add_ps(_mm256_loadu_ps(p + 8), _mm256_permute2f128_ps(lo, hi, 0x31)));
+            _mm256_storeu_ps(dir + i, _mm256_add_ps(d, _mm256_loadu_ps(av + i)));
+        }
+        #elif defined(__SSE2__)
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 d = _mm_loadu_ps(dir + i);
+            __m128 s, c;
+            SinCos(d, s, c);
+            __m128 v = _mm_loadu_ps(speed + i);
+            __m128 dx = _mm_mul_ps(c, v), dy = _mm_mul_ps(s, v);
+            float *p = pos + i*2;
+            _mm_storeu_ps(p, _mm_add_ps(_mm_loadu_ps(p), _mm_unpacklo_ps(dx, dy)));
+            _mm_storeu_ps(p + 4, _mm_add_ps(_mm_loadu_ps(p + 4), _mm_unpackhi_ps(dx, dy)));
+            _mm_storeu_ps(dir + i, _mm_add_ps(d, _mm_loadu_ps(av + i)));
+        }
+        #endif
+
+        for (; i < count; i++)
+        {
+            float s, c;
+            SinCos(dir[i], s, c);
+            pos[i*2] += c * speed[i];
+            pos[i*2+1] += s * speed[i];
+            dir[i] += av[i];
+        }
+    }
+
+    // For each `i`: `++cur_life[i]`. Then writes the indices where `cur_life[i] > life[i]` to `expired`, in increasing order, and returns how many there are.
+    // `expired` must have room for `count` indices.
+    inline std::size_t AgeAndFindExpired(std::size_t count, int *cur_life, const int *life, std::size_t *expired)
+    {
+        std::size_t i = 0, expired_count = 0;
+
+        #if defined(__AVX2__)
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256i c = _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(cur_life + i)), _mm256_set1_epi32(1));
+            _mm256_storeu_si256((__m256i *)(cur_life + i), c);
+            unsigned mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(c, _mm256_loadu_si256((const __m256i *)(life + i)))));
+            for (; mask; mask &= mask - 1)
+                expired[expired_count++] = i + __builtin_ctz(mask);
+        }
+        #elif defined(__SSE2__)
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128i c = _mm_add_epi32(_mm_loadu_si128((const __m128i *)(cur_life + i)), _mm_set1_epi32(1));
+            _mm_storeu_si128((__m128i *)(cur_life + i), c);
+            unsigned mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(c, _mm_loadu_si128((const __m128i *)(life + i)))));
+            for (; mask; mask &= mask - 1)
+                expired[expired_count++] = i + __builtin_ctz(mask);
+        }
+        #endif
+
+        for (; i < count; i++)
+        {
+            if (++cur_life[i] > life[i])
+                expired[expired_count++] = i;
+        }
+        return expired_count;
+    }
+}
+
+#endif
@@ -0,0 +1,89 @@
+#include "memory_file.h"
+
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN
+#  define NOMINMAX
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+MemoryFile MemoryFile::map(std::string file_name)
+{
+    MemoryFile ret;
+    ret.ref = std::make_shared<Data>();
+    ret.ref->begin = ret.ref->end = 0;
+    ret.ref->name = file_name;
+
+    #ifdef _WIN32
+    HANDLE file = CreateFileA(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if (file == INVALID_HANDLE_VALUE)
+        Program::Error("Unable to open file `", file_name, "`.");
+    FINALLY( CloseHandle(file); )
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size))
+        Program::Error("Unable to get size of file `", file_name, "`.");
+    if (size.QuadPart == 0) // Empty files can't be mapped.
+        return ret;
+
+    HANDLE mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+    if (!mapping)
+        Program::Error("Unable to map file `", file_name, "`.");
+    FINALLY( CloseHandle(mapping); ) // The view keeps the mapping alive.
+
+    void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view)
+        Program::Error("Unable to map file `", file_name, "`.");
+
+    ret.ref->begin = static_cast<const uint8_t *>(view);
+    ret.ref->end = ret.ref->begin + size.QuadPart;
+    ret.ref->unmap = [view]{UnmapViewOfFile(view);};
+    #else
+    int file = open(file_name.c_str(), O_RDONLY);
+    if (file == -1)
+        Program::Error("Unable to open file `", file_name, "`.");
+    FINALLY( close(file); ) // The mapping stays valid after the file is closed.
+
+    struct stat info;
+    if (fstat(file, &info) == -1)
+        Program::Error("Unable to get size of file `", file_name, "`.");
+    std::size_t size = info.st_size;
+    if (size == 0) // Empty files can't be mapped.
+        return ret;
+
+    void *view = mmap(0, size, PROT_READ, MAP_PRIVATE, file, 0);
+    if (view == MAP_FAILED)
+        Program::Error("Unable to map file `", file_name, "`.");
+
+    ret.ref->begin = static_cast<const uint8_t *>(view);
+    ret.ref->end = ret.ref->begin + size;
+    ret.ref->unmap = [view, size]{munmap(view, size);};
+    #endif
+
+    return ret;
+}
+
+std::optional<MemoryFile::Info> MemoryFile::info(std::string file_name)
+{
+    Info ret;
+
+    #ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(file_name.c_str(), GetFileExInfoStandard, &data))
+        return {};
+    ret.size = uint64_t(data.nFileSizeHigh) << 32 | data.nFileSizeLow;
+    ret.modification_time = uint64_t(data.ftLastWriteTime.dwHighDateTime) << 32 | data.ftLastWriteTime.dwLowDateTime;
+    #else
+    struct stat data;
+    if (stat(file_name.c_str(), &data) == -1)
+        return {};
+    ret.size = data.st_size;
+    ret.modification_time = uint64_t(data.st_mtim.tv_sec) * 1000000000 + data.st_mtim.tv_nsec;
+    #endif
+
+    return ret;
+}
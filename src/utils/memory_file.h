@@ -4,10 +4,13 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstdio>
+#include <functional>
 #include <memory>
+#include <optional>
 #include <string>
 
 #include "archive.h"
+#include "finally.h"
 #include "strings.h"
 #include "program/errors.h"
 
@@ -18,6 +21,16 @@ class MemoryFile
         std::unique_ptr<uint8_t[]> storage;
         const uint8_t *begin, *end;
         std::string name;
+        std::function<void()> unmap; // Set if the file is memory-mapped.
+
+        Data() {}
+        Data(const Data &) = delete;
+        Data &operator=(const Data &) = delete;
+        ~Data()
+        {
+            if (unmap)
+                unmap();
+        }
     };
 
     std::shared_ptr<Data> ref;
@@ -92,6 +105,18 @@ class MemoryFile
 
         return ret;
     }
+    // Maps the file into memory instead of reading it. The OS loads the pages when they are accessed, so this takes the same time regardless of the file size.
+    // Defined in `memory_file.cpp`, to keep the system headers out of here.
+    [[nodiscard]] static MemoryFile map(std::string file_name);
+
+    struct Info
+    {
+        uint64_t size = 0;
+        uint64_t modification_time = 0; // In system-specific units, only good for comparing.
+    };
+    // Returns the file size and the modification time without opening the file, or null if the file doesn't exist.
+    // Defined in `memory_file.cpp` too.
+    [[nodiscard]] static std::optional<Info> info(std::string file_name);
 
     [[nodiscard]] explicit operator bool() const
     {
@@ -161,10 +186,10 @@ class MemoryFile
     {
         FILE *file = std::fopen(file_name.c_str(), "wb");
         if (!file)
-            Program::Error("Unable to open file for writing: ", name);
+            Program::Error("Unable to open file for writing: ", file_name);
         FINALLY( std::fclose(file); )
         if (!std::fwrite(begin, end - begin, 1, file))
-            Program::Error("Unable to write to file: ", name);
+            Program::Error("Unable to write to file: ", file_name);
     }
 
     static void SaveCompressed(std::string file_name, const uint8_t *begin, const uint8_t *end) // Throws on failure.
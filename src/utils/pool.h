@@ -0,0 +1,174 @@
+#ifndef UTILS_POOL_H_INCLUDED
+#define UTILS_POOL_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/* A pool of objects stored contiguously, in the order of insertion.
+ *
+ * Each object gets a `Handle`, which stays valid until the object is removed. After that, `Find()` returns null for it, even if the slot is reused.
+ * Removal is deferred: `Remove()` only marks the object as dead, and `Compact()` actually removes dead objects while preserving the order of the rest.
+ * Storage (including the free list of slots) is reused, so after warming up, adding and removing objects doesn't allocate.
+ *
+ * Iteration with `begin()` and `end()` includes dead objects, if there were removals since the last `Compact()`. Use `Alive()` to check.
+ */
+
+template <typename T> class Pool
+{
+  public:
+    struct Handle
+    {
+        uint32_t slot = -1;
+        uint32_t generation = 0;
+
+        [[nodiscard]] explicit operator bool() const
+        {
+            return slot != uint32_t(-1);
+        }
+        [[nodiscard]] bool operator==(const Handle &other) const
+        {
+            return slot == other.slot && generation == other.generation;
+        }
+        [[nodiscard]] bool operator!=(const Handle &other) const
+        {
+            return !(*this == other);
+        }
+    };
+
+  private:
+    static constexpr uint32_t none = -1;
+
+    struct Slot
+    {
+        uint32_t index = none; // Index in `objects`, or the next free slot if this one is free.
+        uint32_t generation = 0; // Incremented when the object is removed.
+    };
+
+    std::vector<T> objects;
+    std::vector<uint32_t> object_slots;
+    std::vector<uint8_t> object_alive;
+    std::vector<Slot> slots;
+    uint32_t first_free_slot = none;
+    std::size_t dead_count = 0;
+
+  public:
+    Pool() {}
+
+    Handle Add(T object)
+    {
+        uint32_t slot_index;
+        if (first_free_slot != none)
+        {
+            slot_index = first_free_slot;
+            first_free_slot = slots[slot_index].index;
+        }
+        else
+        {
+            slot_index = slots.size();
+            slots.emplace_back();
+        }
+
+        Slot &slot = slots[slot_index];
+        slot.index = objects.size();
+        objects.push_back(std::move(object));
+        object_slots.push_back(slot_index);
+        object_alive.push_back(1);
+
+        return {slot_index, slot.generation};
+    }
+
+    [[nodiscard]] T *Find(Handle handle) // Returns null if the object was removed.
+    {
+        if (handle.slot >= slots.size() || slots[handle.slot].generation != handle.generation)
+            return 0;
+        return &objects[slots[handle.slot].index];
+    }
+    [[nodiscard]] const T *Find(Handle handle) const
+    {
+        return const_cast<Pool *>(this)->Find(handle);
+    }
+
+    void Remove(Handle handle) // Does nothing if the object was already removed.
+    {
+        if (handle.slot >= slots.size() || slots[handle.slot].generation != handle.generation)
+            return;
+        RemoveAt(slots[handle.slot].index);
+    }
+    void RemoveAt(std::size_t index) // Does nothing if the object was already removed.
+    {
+        if (!object_alive[index])
+            return;
+        object_alive[index] = 0;
+        dead_count++;
+
+        Slot &slot = slots[object_slots[index]];
+        slot.generation++;
+        slot.index = first_free_slot;
+        first_free_slot = object_slots[index];
+    }
+
+    void Compact() // Actually removes the dead objects, keeping the order of the remaining ones.
+    {
+        if (dead_count == 0)
+            return;
+
+        std::size_t out = 0;
+        for (std::size_t i = 0; i < objects.size(); i++)
+        {
+            if (!object_alive[i])
+                continue;
+            if (out != i)
+            {
+                objects[out] = std::move(objects[i]);
+                object_slots[out] = object_slots[i];
+                object_alive[out] = 1;
+            }
+            slots[object_slots[out]].index = out;
+            out++;
+        }
+
+        objects.erase(objects.begin() + out, objects.end());
+        object_slots.resize(out);
+        object_alive.resize(out);
+        dead_count = 0;
+    }
+
+    void Clear()
+    {
+        for (std::size_t i = 0; i < objects.size(); i++)
+            RemoveAt(i);
+        Compact();
+    }
+
+    [[nodiscard]] std::size_t Size() const // Includes dead objects that weren't compacted yet.
+    {
+        return objects.size();
+    }
+    [[nodiscard]] std::size_t AliveCount() const
+    {
+        return objects.size() - dead_count;
+    }
+
+    [[nodiscard]] bool Alive(std::size_t index) const
+    {
+        return object_alive[index];
+    }
+    [[nodiscard]] Handle HandleAt(std::size_t index) const // Returns a null handle if the object is dead.
+    {
+        if (!object_alive[index])
+            return {};
+        return {object_slots[index], slots[object_slots[index]].generation};
+    }
+
+    [[nodiscard]] T &operator[](std::size_t index) {return objects[index];}
+    [[nodiscard]] const T &operator[](std::size_t index) const {return objects[index];}
+
+    [[nodiscard]] auto begin() {return objects.begin();}
+    [[nodiscard]] auto end() {return objects.end();}
+    [[nodiscard]] auto begin() const {return objects.begin();}
+    [[nodiscard]] auto end() const {return objects.end();}
+};
+
+#endif
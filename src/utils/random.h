@@ -1,83 +1,321 @@
 #ifndef RANDOM_H_INCLUDED
 #define RANDOM_H_INCLUDED
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <ctime>
 #include <type_traits>
 #include <random>
 
 namespace Rand
 {
-    inline std::mt19937 &Generator()
+    class Pcg32 // PCG-XSH-RR, see http://www.pcg-random.org. Much smaller and faster than `std::mt19937`. Different streams with the same seed produce unrelated sequences.
     {
-        static std::mt19937 generator(std::time(0)); // We don't use `std::random_device` because it's broken on MinGW.
-        return generator;
+        inline static constexpr uint64_t multiplier = 6364136223846793005ull;
+
+        uint64_t state = 0, inc = 1;
+
+        [[nodiscard]] static uint32_t Output(uint64_t state)
+        {
+            uint32_t xorshifted = ((state >> 18) ^ state) >> 27;
+            uint32_t rot = state >> 59;
+            return xorshifted >> rot | xorshifted << (-rot & 31);
+        }
+
+      public:
+        using result_type = uint32_t;
+
+        Pcg32() : Pcg32(0) {}
+        Pcg32(uint64_t seed, uint64_t stream = 0)
+        {
+            this->seed(seed, stream);
+        }
+
+        void seed(uint64_t seed, uint64_t stream = 0)
+        {
+            state = 0;
+            inc = stream << 1 | 1;
+            (*this)();
+            state += seed;
+            (*this)();
+        }
+
+        [[nodiscard]] static constexpr result_type min() {return 0;}
+        [[nodiscard]] static constexpr result_type max() {return 0xffffffff;}
+
+        result_type operator()()
+        {
+            uint64_t old_state = state;
+            state = old_state * multiplier + inc;
+            return Output(old_state);
+        }
+
+        // Writes the same values that `operator()` would return one by one.
+        // Runs 4 interleaved copies of the state, each jumping 4 steps at a time, so the multiplications don't wait for each other.
+        void fill(result_type *begin, result_type *end)
+        {
+            constexpr uint64_t multiplier_4 = multiplier * multiplier * multiplier * multiplier;
+            const uint64_t inc_4 = inc * (multiplier * multiplier * multiplier + multiplier * multiplier + multiplier + 1);
+
+            uint64_t s0 = state, s1 = s0 * multiplier + inc, s2 = s1 * multiplier + inc, s3 = s2 * multiplier + inc;
+            while (end - begin >= 4)
+            {
+                begin[0] = Output(s0);
+                begin[1] = Output(s1);
+                begin[2] = Output(s2);
+                begin[3] = Output(s3);
+                begin += 4;
+                s0 = s0 * multiplier_4 + inc_4;
+                s1 = s1 * multiplier_4 + inc_4;
+                s2 = s2 * multiplier_4 + inc_4;
+                s3 = s3 * multiplier_4 + inc_4;
+            }
+            state = s0;
+            while (begin != end)
+                *begin++ = (*this)();
+        }
+    };
+
+    using generator_t = Pcg32;
+
+    namespace impl
+    {
+        inline uint32_t seed = std::time(0); // We don't use `std::random_device` because it's broken on MinGW.
+        inline generator_t *generator_override = 0;
+
+        // `0 <= returned_value < n`, `n` must be positive. This is Lemire's multiply-and-reject method, it avoids divisions in most cases.
+        // It keeps drawing until the low half of `gen() * n` is at least `-n % n`. The batch functions below rely on that.
+        inline uint32_t Below(generator_t &gen, uint32_t n)
+        {
+            uint64_t m = uint64_t(gen()) * n;
+            if (uint32_t(m) < n)
+            {
+                uint32_t threshold = -n % n;
+                while (uint32_t(m) < threshold)
+                    m = uint64_t(gen()) * n;
+            }
+            return m >> 32;
+        }
+
+        // How many values of `gen()` are needed to make one real number.
+        template <typename T> inline constexpr int words_per_unit = sizeof(T) <= sizeof(float) ? 1 : 2;
+
+        // `0 <= returned_value < 1`. `words` must contain `words_per_unit<T>` values of `gen()`, in the order they were generated.
+        template <typename T> T UnitFromWords(const uint32_t *words)
+        {
+            if constexpr (words_per_unit<T> == 1)
+                return T(words[0] >> 8) * T(1.f / (1 << 24));
+            else
+                return T((uint64_t(words[0]) << 32 | words[1]) >> 11) * T(1. / (1ull << 53));
+        }
+
+        // `0 <= returned_value < 1`.
+        template <typename T> T Unit(generator_t &gen)
+        {
+            uint32_t words[words_per_unit<T>];
+            for (uint32_t &word : words)
+                word = gen();
+            return UnitFromWords<T>(words);
+        }
+
+        inline constexpr int batch_words = 64; // The batch functions generate this many values of `gen()` at once.
     }
 
-    // `std::enable_if_t<1,T>` is there to make sure `T` is never deduced.
+    // Independent streams for different subsystems. Cosmetic effects can use as much randomness as they want without changing the gameplay.
+    inline generator_t gameplay(impl::seed, 0), vfx(impl::seed, 1), audio(impl::seed, 2);
 
-    // `0 <= returned_value < x`. (If `x < 0`, returns -random_int(-x). If `x == 0`, returns 0.) Sic! Unlike `random_real`, `x` can not be returned unless it's `0`.
-    template <typename T = int> T random_int(std::enable_if_t<1,T> x)
+    inline generator_t &Generator() // Returns `gameplay`, unless it's overridden with `GeneratorOverride`.
     {
-        static_assert(std::is_integral_v<T>, "The template parameter must be integral.");
-        if (x > 0)
-            return std::uniform_int_distribution<T>(0, x-1)(Generator());
-        else if (x < 0)
-            return std::uniform_int_distribution<T>(1-x, 0)(Generator());
-        else
-            return 0;
+        if (impl::generator_override)
+            return *impl::generator_override;
+        return gameplay;
+    }
+
+    inline uint32_t Seed() // Returns the last seed.
+    {
+        return impl::seed;
+    }
+    inline void Seed(uint32_t seed) // Reseeds all streams.
+    {
+        impl::seed = seed;
+        gameplay.seed(seed, 0);
+        vfx.seed(seed, 1);
+        audio.seed(seed, 2);
     }
 
+    class GeneratorOverride // While this object exists, `Generator()` returns the passed generator instead of the default one.
+    {
+        generator_t *old;
+
+      public:
+        GeneratorOverride(generator_t &generator) : old(impl::generator_override)
+        {
+            impl::generator_override = &generator;
+        }
+        GeneratorOverride(const GeneratorOverride &) = delete;
+        GeneratorOverride &operator=(const GeneratorOverride &) = delete;
+        ~GeneratorOverride()
+        {
+            impl::generator_override = old;
+        }
+    };
+
+    // `std::enable_if_t<1,T>` is there to make sure `T` is never deduced.
+    // Every function has an overload that takes a generator as the first parameter. Others use `Generator()`.
+
     // `a <= returned_value <= b`. (If `b < a`, they are swapped.)
-    template <typename T = int> T random_int_range(std::enable_if_t<1,T> a, std::enable_if_t<1,T> b)
+    template <typename T = int> T random_int_range(generator_t &gen, std::enable_if_t<1,T> a, std::enable_if_t<1,T> b)
     {
         static_assert(std::is_integral_v<T>, "The template parameter must be integral.");
-        // We don't handle `a == b` separately, it seems to be well-defined.
-        if (a < b)
-            return std::uniform_int_distribution<T>(a, b)(Generator());
+        if (b < a)
+            std::swap(a, b);
+        if constexpr (sizeof(T) > sizeof(uint32_t))
+        {
+            return std::uniform_int_distribution<T>(a, b)(gen);
+        }
         else
-            return std::uniform_int_distribution<T>(b, a)(Generator());
+        {
+            uint32_t n = uint32_t(b) - uint32_t(a) + 1;
+            if (n == 0) // The whole range of a 32-bit type.
+                return T(gen());
+            return T(uint32_t(a) + impl::Below(gen, n));
+        }
+    }
+    template <typename T = int> T random_int_range(std::enable_if_t<1,T> a, std::enable_if_t<1,T> b)
+    {
+        return random_int_range<T>(Generator(), a, b);
     }
 
     // `-x <= returned_value <= x`. (If `x < 0`, it's negated.)
-    template <typename T = int> T random_int_range(std::enable_if_t<1,T> x)
+    template <typename T = int> T random_int_range(generator_t &gen, std::enable_if_t<1,T> x)
     {
         static_assert(std::is_integral_v<T> && std::is_signed_v<T>, "The template parameter must be integral and signed.");
-        return random_int_range<T>(-x, x);
+        return random_int_range<T>(gen, -x, x);
+    }
+    template <typename T = int> T random_int_range(std::enable_if_t<1,T> x)
+    {
+        return random_int_range<T>(Generator(), x);
     }
 
-    // `0 <= returned_value <= x`. (If `x < 0`, returns -random_int(-x).) Sic! Unlike `random_int`, `x` can be returned.
-    template <typename T = float> T random_real(std::enable_if_t<1,T> x)
+    // `0 <= returned_value < x`. (If `x < 0`, returns -random_int(-x). If `x == 0`, returns 0.) `x` can not be returned unless it's `0`.
+    template <typename T = int> T random_int(generator_t &gen, std::enable_if_t<1,T> x)
     {
-        static_assert(std::is_floating_point_v<T>, "The template parameter must be floating-point.");
+        static_assert(std::is_integral_v<T>, "The template parameter must be integral.");
         if (x > 0)
-            return std::uniform_real_distribution<T>(0, x)(Generator());
+            return random_int_range<T>(gen, 0, x-1);
         else if (x < 0)
-            return std::uniform_real_distribution<T>(x, 0)(Generator());
+            return -random_int_range<T>(gen, 0, -x-1);
         else
             return 0;
     }
+    template <typename T = int> T random_int(std::enable_if_t<1,T> x)
+    {
+        return random_int<T>(Generator(), x);
+    }
 
-    // `a <= returned_value <= b`. (If `b < a`, they are swapped.)
-    template <typename T = float> T random_real_range(std::enable_if_t<1,T> a, std::enable_if_t<1,T> b)
+    // `a <= returned_value < b`, except that rounding can occasionally produce `b`. (If `b < a`, the range is `b < returned_value <= a`.)
+    template <typename T = float> T random_real_range(generator_t &gen, std::enable_if_t<1,T> a, std::enable_if_t<1,T> b)
     {
         static_assert(std::is_floating_point_v<T>, "The template parameter must be floating-point.");
-        if (a < b)
-            return std::uniform_real_distribution<T>(a, b)(Generator());
-        else if (b < a)
-            return std::uniform_real_distribution<T>(b, a)(Generator());
-        else // We need to handle `a == b` separately. It doesn't seem to be well defined for reals (it is for integers, though).
-            return a;
+        return a + (b - a) * impl::Unit<T>(gen);
+    }
+    template <typename T = float> T random_real_range(std::enable_if_t<1,T> a, std::enable_if_t<1,T> b)
+    {
+        return random_real_range<T>(Generator(), a, b);
     }
 
-    // `-x <= returned_value <= x`. (If `x < 0`, it's negated.)
+    // `-x <= returned_value < x`, except that rounding can occasionally produce `x`. (If `x < 0`, it's negated.)
+    template <typename T = float> T random_real_range(generator_t &gen, std::enable_if_t<1,T> x)
+    {
+        return random_real_range<T>(gen, -x, x);
+    }
     template <typename T = float> T random_real_range(std::enable_if_t<1,T> x)
     {
-        return random_real_range<T>(-x, x);
+        return random_real_range<T>(Generator(), x);
+    }
+
+    // `0 <= returned_value < x`, except that rounding can occasionally produce `x`. (If `x < 0`, the range is `x < returned_value <= 0`.)
+    template <typename T = float> T random_real(generator_t &gen, std::enable_if_t<1,T> x)
+    {
+        return random_real_range<T>(gen, 0, x);
+    }
+    template <typename T = float> T random_real(std::enable_if_t<1,T> x)
+    {
+        return random_real<T>(Generator(), x);
+    }
+
+    inline int random_sign(generator_t &gen)
+    {
+        return int(gen() >> 31) * 2 - 1;
+    }
+    inline int random_sign()
+    {
+        return random_sign(Generator());
+    }
+
+    // Batch versions. They write to `[begin, end)` the same values that the scalar functions above would return one by one,
+    // but generate the random bits with `Pcg32::fill()`, and compute the range parameters only once.
+
+    template <typename T> void fill_random_int_range(generator_t &gen, T *begin, T *end, std::enable_if_t<1,T> a, std::enable_if_t<1,T> b)
+    {
+        static_assert(std::is_integral_v<T>, "The template parameter must be integral.");
+        if constexpr (sizeof(T) > sizeof(uint32_t))
+        {
+            while (begin != end)
+                *begin++ = random_int_range<T>(gen, a, b);
+        }
+        else
+        {
+            if (b < a)
+                std::swap(a, b);
+            uint32_t n = uint32_t(b) - uint32_t(a) + 1;
+            uint32_t threshold = n == 0 ? 0 : -n % n; // `n == 0` means the whole range of a 32-bit type.
+
+            uint32_t words[impl::batch_words];
+            while (begin != end)
+            {
+                // Rejected values make us need more words than we have numbers left, so we generate only as many words as there are numbers left, and repeat.
+                // This way we consume exactly as many words as `random_int_range()` would.
+                std::size_t count = std::min<std::size_t>(end - begin, impl::batch_words);
+                gen.fill(words, words + count);
+                for (std::size_t i = 0; i < count; i++)
+                {
+                    if (n == 0)
+                    {
+                        *begin++ = T(words[i]);
+                        continue;
+                    }
+                    uint64_t m = uint64_t(words[i]) * n;
+                    if (uint32_t(m) >= threshold)
+                        *begin++ = T(uint32_t(a) + uint32_t(m >> 32));
+                }
+            }
+        }
+    }
+    template <typename T> void fill_random_int_range(T *begin, T *end, std::enable_if_t<1,T> a, std::enable_if_t<1,T> b)
+    {
+        fill_random_int_range<T>(Generator(), begin, end, a, b);
     }
 
-    int random_sign()
+    template <typename T> void fill_random_real_range(generator_t &gen, T *begin, T *end, std::enable_if_t<1,T> a, std::enable_if_t<1,T> b)
     {
-        return random_int(2) * 2 - 1;
+        static_assert(std::is_floating_point_v<T>, "The template parameter must be floating-point.");
+        constexpr int words_per_unit = impl::words_per_unit<T>;
+        T delta = b - a;
+
+        uint32_t words[impl::batch_words];
+        while (begin != end)
+        {
+            std::size_t count = std::min<std::size_t>(end - begin, impl::batch_words / words_per_unit);
+            gen.fill(words, words + count * words_per_unit);
+            for (std::size_t i = 0; i < count; i++)
+                *begin++ = a + delta * impl::UnitFromWords<T>(words + i * words_per_unit);
+        }
+    }
+    template <typename T> void fill_random_real_range(T *begin, T *end, std::enable_if_t<1,T> a, std::enable_if_t<1,T> b)
+    {
+        fill_random_real_range<T>(Generator(), begin, end, a, b);
     }
 }
 
@@ -86,6 +324,7 @@ using Rand::random_int_range;
 using Rand::random_real;
 using Rand::random_real_range;
 using Rand::random_sign;
+using Rand::fill_random_int_range;
+using Rand::fill_random_real_range;
 
 #endif
-
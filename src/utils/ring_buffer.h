@@ -0,0 +1,57 @@
+#ifndef UTILS_RING_BUFFER_H_INCLUDED
+#define UTILS_RING_BUFFER_H_INCLUDED
+
+#include <cstddef>
+#include <vector>
+
+/* A fixed-capacity buffer that keeps the last `Capacity()` added elements.
+ * Slots are never destroyed, `Push()` returns the slot to overwrite. Assigning to it reuses the storage of the old element, so after warming up this doesn't allocate.
+ * Index 0 is the oldest element.
+ */
+
+template <typename T> class RingBuffer
+{
+    std::vector<T> slots;
+    std::size_t first = 0, count = 0;
+
+    [[nodiscard]] std::size_t SlotIndex(std::size_t index) const
+    {
+        return (first + index) % slots.size();
+    }
+
+  public:
+    RingBuffer() {}
+    RingBuffer(std::size_t capacity) : slots(capacity) {} // `capacity` must be positive.
+
+    [[nodiscard]] std::size_t Capacity() const {return slots.size();}
+    [[nodiscard]] std::size_t Size() const {return count;}
+    [[nodiscard]] bool Empty() const {return count == 0;}
+
+    [[nodiscard]] T &Push() // If the buffer is full, the oldest element is dropped and its slot is returned.
+    {
+        if (count < slots.size())
+            return slots[SlotIndex(count++)];
+        T &ret = slots[first];
+        first = SlotIndex(1);
+        return ret;
+    }
+
+    void PopNewest() // The slot keeps its value, but it's not accessible until the next `Push()`.
+    {
+        if (count > 0)
+            count--;
+    }
+
+    void Clear()
+    {
+        first = count = 0;
+    }
+
+    [[nodiscard]] T &operator[](std::size_t index) {return slots[SlotIndex(index)];}
+    [[nodiscard]] const T &operator[](std::size_t index) const {return slots[SlotIndex(index)];}
+
+    [[nodiscard]] T &Newest() {return (*this)[count-1];}
+    [[nodiscard]] const T &Newest() const {return (*this)[count-1];}
+};
+
+#endif
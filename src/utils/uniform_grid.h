@@ -0,0 +1,88 @@
+#ifndef UTILS_UNIFORM_GRID_H_INCLUDED
+#define UTILS_UNIFORM_GRID_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "utils/mat.h"
+
+/* Sorts object indices into square cells, so that objects near a point can be found without checking all of them.
+ * The grid doesn't track objects, so it has to be rebuilt after they move or after the indices change.
+ * Objects outside of the grid bounds go to the border cells, so nothing is lost.
+ * Rebuilding reuses the storage, so it doesn't allocate after warming up.
+ */
+
+class UniformGrid
+{
+    fvec2 origin = fvec2(0);
+    float cell_size = 1;
+    ivec2 cell_count = ivec2(1);
+
+    std::vector<uint32_t> cell_start; // Objects in cell `i` are `entries[cell_start[i]]` to `entries[cell_start[i+1]]`, not inclusive.
+    std::vector<uint32_t> entries;
+    std::vector<uint32_t> object_cells;
+
+    [[nodiscard]] ivec2 CellPos(fvec2 pos) const
+    {
+        return clamp(ivec2((pos - origin) / cell_size), ivec2(0), cell_count - 1);
+    }
+    [[nodiscard]] int CellIndex(ivec2 cell) const
+    {
+        return cell.y * cell_count.x + cell.x;
+    }
+
+  public:
+    UniformGrid() {}
+    UniformGrid(fvec2 origin, fvec2 size, float cell_size)
+    {
+        Reset(origin, size, cell_size);
+    }
+
+    void Reset(fvec2 new_origin, fvec2 size, float new_cell_size) // Removes all objects.
+    {
+        origin = new_origin;
+        cell_size = new_cell_size;
+        cell_count = max(ivec2(1), ivec2(size / cell_size) + 1);
+        cell_start.assign(cell_count.prod() + 1, 0);
+        entries.clear();
+    }
+
+    // `get_pos(i)` should return the position of object `i`, for every `0 <= i < count`.
+    template <typename F> void Build(std::size_t count, F &&get_pos)
+    {
+        object_cells.resize(count);
+        cell_start.assign(cell_start.size(), 0);
+
+        for (std::size_t i = 0; i < count; i++)
+        {
+            object_cells[i] = CellIndex(CellPos(get_pos(i)));
+            cell_start[object_cells[i] + 1]++;
+        }
+        for (std::size_t i = 1; i < cell_start.size(); i++)
+            cell_start[i] += cell_start[i-1];
+
+        // Now `cell_start[i+1]` points to the end of cell `i`. We fill each cell backwards, which moves that value to the beginning of the cell.
+        entries.resize(count);
+        for (std::size_t i = count; i-- > 0;)
+            entries[--cell_start[object_cells[i] + 1]] = i;
+        for (std::size_t i = 0; i + 1 < cell_start.size(); i++)
+            cell_start[i] = cell_start[i+1];
+        cell_start.back() = count;
+    }
+
+    // Calls `func(i)` for every object in the cells that intersect the square of half-size `radius` around `pos`.
+    // Objects are sorted by index within each cell, but not across cells. Some of them can be farther than `radius`, the caller has to check the exact condition.
+    template <typename F> void Query(fvec2 pos, float radius, F &&func) const
+    {
+        ivec2 a = CellPos(pos - radius), b = CellPos(pos + radius);
+        for (int y = a.y; y <= b.y; y++)
+        {
+            int row = CellIndex(ivec2(0, y));
+            for (uint32_t i = cell_start[row + a.x]; i < cell_start[row + b.x + 1]; i++)
+                func(std::size_t(entries[i]));
+        }
+    }
+};
+
+#endif